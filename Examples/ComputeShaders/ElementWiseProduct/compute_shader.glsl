@@ -1,4 +1,4 @@
-#version 460 core
+#version 450 core
 
 layout(std430) buffer;
 layout(local_size_x = 1024) in;
@@ -1,49 +1,20 @@
 #include <iostream>
 #include <vector>
 #include <GL/glew.h>
-#include <GLFW/glfw3.h>
 
+#include "context.h"
+#include "cpu.h"
+#include "readback.h"
 #include "shaderprogram.h"
 
 constexpr GLuint WIDTH = 512, HEIGHT = 512;
 constexpr GLsizei NUM_ELEMENTS = 2048;
 
-void error_callback(GLint error, const GLchar* description);
-void elementWiseProduct(const std::vector<GLfloat>& a,
-                          const std::vector<GLfloat>& b,
-                          std::vector<GLfloat>& output);
-
 int main()
 {
-    glfwSetErrorCallback(error_callback);
-
-    glfwInit();
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Element Wise Product",
-                                          nullptr, nullptr);
-
-    if(!window)
-    {
-        glfwTerminate();
-        exit(1);
-    }
-
-    glfwMakeContextCurrent(window);
-
-    glewExperimental = GL_TRUE;
-    GLenum status = glewInit();
-
-    if (status != GLEW_OK)
-    {
-        std::cerr << "GLEW Error: " << glewGetErrorString(status) << "\n";
-        glfwTerminate();
-        exit(1);
-    }
+    // This is a pure compute job so it doesn't need a window
+    simgll::Context context(simgll::Context::Type::Headless, WIDTH, HEIGHT,
+                            "Element Wise Product", 4, 5);
 
     simgll::ShaderProgram computeProgram;
     computeProgram.addShader("compute_shader.glsl", GL_COMPUTE_SHADER);
@@ -75,8 +46,6 @@ int main()
         inputDataB[i] = static_cast<GLfloat>(i);
     }
 
-    elementWiseProduct(inputDataA, inputDataB, outputData);
-
     // Bind and initialize input buffers
     glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, dataBuffers[0], 0,
                       NUM_ELEMENTS * sizeof(GLfloat));
@@ -95,50 +64,36 @@ int main()
     computeProgram.use();
     glDispatchCompute(1, 1, 1);
 
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-    glFinish();
-
-    GLfloat* ptr;
-    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, dataBuffers[2], 0,
-                      NUM_ELEMENTS * sizeof(GLfloat));
-    ptr = (GLfloat*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0,
-                                     NUM_ELEMENTS * sizeof(GLfloat),
-                                     GL_MAP_READ_BIT);
+    simgll::ReadbackQueue readback(NUM_ELEMENTS * sizeof(GLfloat), 1);
 
-    std::cout << "Shader results: " << "\n";
-    for (GLuint i = 0; i < NUM_ELEMENTS; i++)
+    readback.enqueue(dataBuffers[2], 0, NUM_ELEMENTS * sizeof(GLfloat),
+                     [](const GLvoid* data, GLsizeiptr)
     {
-        std::cout << *ptr++ << ", ";
-    }
+        const GLfloat* ptr = static_cast<const GLfloat*>(data);
+
+        std::cout << "Shader results: " << "\n";
+        for (GLsizei i = 0; i < NUM_ELEMENTS; i++)
+        {
+            std::cout << *ptr++ << ", ";
+        }
+    });
+
+    // Compute the CPU reference while the GPU is busy, the only wait is for
+    // the readback fence
+    simgll::cpu::elementWise(simgll::cpu::Op::Multiply, inputDataA.data(),
+                             inputDataB.data(), outputData.data(),
+                             NUM_ELEMENTS);
+
+    readback.flush();
 
     std::cout << "\nCPU results: " << "\n";
-    for (GLuint i = 0; i < NUM_ELEMENTS; i++)
+    for (GLsizei i = 0; i < NUM_ELEMENTS; i++)
     {
         std::cout << outputData[i] << ", ";
     }
 
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-
     // Delete GL objects
     glDeleteBuffers(3, dataBuffers);
 
-    glfwTerminate();
-
     return 0;
 }
-
-
-void error_callback(GLint error, const GLchar* description)
-{
-    std::cerr << "GLFW Error " << error << ": " << description << "\n";
-}
-
-void elementWiseProduct(const std::vector<GLfloat>& a,
-                        const std::vector<GLfloat>& b,
-                        std::vector<GLfloat>& output)
-{
-    for (GLsizei i = 0; i < NUM_ELEMENTS; ++i)
-    {
-        output[i] = a[i] * b[i];
-    }
-}
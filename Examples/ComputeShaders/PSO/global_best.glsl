@@ -0,0 +1,60 @@
+#version 450 core
+
+// SOA_LAYOUT is injected by the host when the swarm is stored as separate
+// streams
+
+layout (local_size_x = 1) in;
+
+struct Particle
+{
+    vec3 position;
+    vec3 velocity;
+    vec3 bestPosition;
+    float fitness;
+};
+
+#ifdef SOA_LAYOUT
+layout (std430, binding = 0) readonly buffer swarmPositions
+{
+    float positions[];
+} swarmData;
+
+vec3 particlePosition(uint i)
+{
+    return vec3(swarmData.positions[3 * i],
+                swarmData.positions[3 * i + 1],
+                swarmData.positions[3 * i + 2]);
+}
+#else
+layout (std430, binding = 0) readonly buffer swarm
+{
+    Particle particles[];
+} swarmData;
+
+vec3 particlePosition(uint i)
+{
+    return swarmData.particles[i].position;
+}
+#endif
+
+// Fittest particle of the last iteration, written by the argmin reduction
+layout (std430, binding = 1) readonly buffer bestCandidate
+{
+    float fitness;
+    uint index;
+} candidate;
+
+layout (std430, binding = 2) buffer globalBest
+{
+    vec3 position;
+    float fitness;
+} best;
+
+void main()
+{
+    if(candidate.fitness < best.fitness)
+    {
+        best.position = particlePosition(candidate.index);
+        best.fitness  = candidate.fitness;
+    }
+}
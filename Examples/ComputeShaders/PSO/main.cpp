@@ -1,15 +1,26 @@
+#include <array>
 #include <iostream>
 #include <cstdlib>
 #include <cmath>
 #include <random>
 #include <chrono>
+#include <string>
+#include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "context.h"
+#include "buffer.h"
+#include "compute.h"
+#include "cpu.h"
+#include "objective.h"
 #include "shaderprogram.h"
+#include "random.h"
+#include "readback.h"
+#include "threadpool.h"
 #include "camera.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -19,7 +30,15 @@ constexpr GLuint WIDTH            = 512;
 constexpr GLuint HEIGHT           = 512;
 constexpr GLint NUM_ITER          = 10000;
 constexpr GLfloat PSO_UPDATE_TIME = 0.016F;
-constexpr float PI                = 3.1415926535F;
+
+// The initial state uses the first INIT_COUNTERS counters and iteration i
+// uses INIT_COUNTERS + i
+constexpr GLuint INIT_COUNTERS    = 2;
+
+// Relative tolerance of the check of the first iteration against the CPU
+// backend, the transcendental functions of the objectives are less precise
+// on the GPU
+constexpr GLfloat CHECK_TOLERANCE = 1e-3F;
 
 enum
 {
@@ -28,6 +47,9 @@ enum
     SWARM_SIZE      = (NUM_WORKGROUPS * WORKGROUP_SIZE)
 };
 
+// Record of the AoS layout, the SoA layout stores positions, velocities and
+// best positions as tightly packed vec3 streams and the fitness only in
+// fitnessBuffer
 struct Particle
 {
     glm::vec3 position;
@@ -38,47 +60,55 @@ struct Particle
     float fitness;
 };
 
-// Test functions
-GLfloat goldsteinPrice(glm::vec2 p);
-GLfloat rastrigin3D(const glm::vec3& p);
+// Mirrors the globalBest block of pso.glsl
+struct GlobalBest
+{
+    glm::vec3 position;
+    float fitness;
+};
 
-glm::vec3 getBestPosition(Particle* p);
+glm::vec3 getBestPosition(const Particle* p);
 
 GLvoid error_callback(GLint error, const GLchar* description);
 
-int main()
+int main(int argc, char* argv[])
 {
-    glfwSetErrorCallback(error_callback);
+    // Any objective of the registry with at most 3 dimensions can be
+    // selected from the command line: PSO [objective] [aos|soa]
+    const simgll::Objective& objective =
+        simgll::findObjective(argc > 1 ? argv[1] : "goldsteinPrice");
+    GLuint dimensions = objective.dimensions ? objective.dimensions : 3;
 
-    glfwInit();
+    if(dimensions > 3)
+    {
+        std::cerr << objective.name << " can't be displayed in 3D\n";
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+        exit(1);
+    }
 
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "OpenGL App",
-                                          nullptr, nullptr);
+    std::string layout = argc > 2 ? argv[2] : "aos";
 
-    if(!window)
+    if(layout != "aos" && layout != "soa")
     {
-        glfwTerminate();
+        std::cerr << "Unknown layout " << layout << ", available: aos soa\n";
+
         exit(1);
     }
 
-    glfwMakeContextCurrent(window);
-    //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    glewExperimental = GL_TRUE;
-    GLenum status = glewInit();
+    GLboolean soa = layout == "soa";
+    std::string layoutDefine = soa ? "#define SOA_LAYOUT\n" : "";
 
-    if(status != GLEW_OK)
+    auto f = [&objective, dimensions](const glm::vec3& p)
     {
-        std::cerr << "GLEW error: " << glewGetErrorString(status) << "\n";
+        return objective.evaluate(&p.x, dimensions);
+    };
 
-        glfwTerminate();
-        exit(1);
-    }
+    glfwSetErrorCallback(error_callback);
+
+    simgll::Context context(simgll::Context::Type::Window, WIDTH, HEIGHT,
+                            "OpenGL App", 4, 3);
+    GLFWwindow* window = context.window();
+    //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // Setup DearImGui contxt
     IMGUI_CHECKVERSION();
@@ -106,21 +136,51 @@ int main()
     GLint mvpLocation = renderProgram.getLocation("mvp");
 
     simgll::ShaderProgram psoProgram;
-    psoProgram.addShader("pso.glsl", GL_COMPUTE_SHADER);
+    psoProgram.addShader("pso.glsl", GL_COMPUTE_SHADER,
+                         layoutDefine + objective.glsl(dimensions) +
+                         simgll::philoxGlsl());
     psoProgram.compile();
 
     GLint omegaLocation   = psoProgram.getLocation("omega");
-    GLint cpuSeedLocation = psoProgram.getLocation("cpuSeed");
-
-    // Create swarm buffers
-    GLuint psoBuffers[2];
-    glGenBuffers(2, psoBuffers);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, psoBuffers[0]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, SWARM_SIZE * sizeof(Particle),
-                 nullptr, GL_DYNAMIC_COPY);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, psoBuffers[1]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, SWARM_SIZE * sizeof(Particle),
-                 nullptr, GL_DYNAMIC_COPY);
+    GLint seedLocation    = psoProgram.getLocation("seed");
+    GLint counterLocation = psoProgram.getLocation("counter");
+
+    simgll::ShaderProgram globalBestProgram;
+    globalBestProgram.addShader("global_best.glsl", GL_COMPUTE_SHADER,
+                                layoutDefine);
+    globalBestProgram.compile();
+
+    // The fittest particle of every iteration is found on the GPU and merged
+    // into the global best by global_best.glsl
+    simgll::compute::ArgReduce argmin(simgll::compute::Type::Float,
+                                      simgll::compute::Op::Min);
+
+    simgll::Buffer<GLfloat> fitnessBuffer(SWARM_SIZE, GL_DYNAMIC_STORAGE_BIT);
+    simgll::Buffer<GLuint> candidateBuffer(2);
+
+    // Create swarm buffers, with the AoS layout every stream is the same
+    // buffer of Particle records
+    GLuint positionBuffers[2];
+    GLuint velocityBuffers[2];
+    GLuint bestPositionBuffers[2];
+    glGenBuffers(2, positionBuffers);
+
+    if(soa)
+    {
+        glGenBuffers(2, velocityBuffers);
+        glGenBuffers(2, bestPositionBuffers);
+    }
+    else
+    {
+        for(int i = 0; i < 2; ++i)
+        {
+            velocityBuffers[i]     = positionBuffers[i];
+            bestPositionBuffers[i] = positionBuffers[i];
+        }
+    }
+
+    GLsizei stride          = soa ? sizeof(glm::vec3) : sizeof(Particle);
+    GLintptr velocityOffset = soa ? 0 : sizeof(glm::vec4);
 
     // Initialize PRNG
     std::random_device rd;
@@ -137,39 +197,89 @@ int main()
         seed = static_cast<unsigned> (std::chrono::system_clock::now().time_since_epoch().count());
     }
 
-    std::mt19937 engine(seed);
-    std::uniform_real_distribution<> dist(-2.0F, 2.0F);
-
-    // Get a pointer to the first buffer so we can initialize its contents
-    glBindBuffer(GL_ARRAY_BUFFER, psoBuffers[0]);
-    Particle* p = reinterpret_cast<Particle*>(
-        glMapBufferRange(GL_ARRAY_BUFFER, 0, SWARM_SIZE * sizeof(Particle),
-                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    std::vector<Particle> p(SWARM_SIZE);
 
-    // Initialize position, velocity and fitness
-    auto f = goldsteinPrice;
+    auto domain = [&objective](GLuint bits)
+    {
+        return objective.lower +
+            simgll::uniformFloat(bits) * (objective.upper - objective.lower);
+    };
 
-    for(int i = 0; i < SWARM_SIZE; ++i)
+    // Initialize position, velocity and fitness, a workgroup of particles
+    // per task
+    simgll::ThreadPool::global().parallelFor(0, SWARM_SIZE, WORKGROUP_SIZE,
+        [&](std::size_t first, std::size_t last)
     {
-        p[i].position.x = dist(engine);
-        p[i].position.y = dist(engine);
-        p[i].position.z = 0.0F;
+        for(std::size_t i = first; i < last; ++i)
+        {
+            GLuint stream = static_cast<GLuint>(i);
+            std::array<GLuint, 4> position = simgll::philox(seed, stream, 0);
+            std::array<GLuint, 4> velocity = simgll::philox(seed, stream, 1);
 
-        p[i].velocity.x = dist(engine);
-        p[i].velocity.y = dist(engine);
-        p[i].velocity.z = 0.0F;
+            p[i].position.x = domain(position[0]);
+            p[i].position.y = domain(position[1]);
+            p[i].position.z = dimensions > 2 ? domain(position[2]) : 0.0F;
 
-        p[i].bestPosition = p[i].position;
+            p[i].velocity.x = domain(velocity[0]);
+            p[i].velocity.y = domain(velocity[1]);
+            p[i].velocity.z = dimensions > 2 ? domain(velocity[2]) : 0.0F;
 
-        p[i].fitness = f(p[i].position);
-    }
+            p[i].bestPosition = p[i].position;
+
+            p[i].fitness = f(p[i].position);
+        }
+    });
 
-    glm::vec3 bestPosition = getBestPosition(p);
+    glm::vec3 bestPosition = getBestPosition(p.data());
     std::cout << bestPosition.x << " " << bestPosition.y << " " << bestPosition.z << "\n";
 
-    GLint bestPositionLocation = psoProgram.getLocation("bestPosition");
+    // Only the input buffers of the first iteration need initial contents
+    if(soa)
+    {
+        std::vector<glm::vec3> positions(SWARM_SIZE);
+        std::vector<glm::vec3> velocities(SWARM_SIZE);
+        std::vector<GLfloat> fitness(SWARM_SIZE);
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+        for(int i = 0; i < SWARM_SIZE; ++i)
+        {
+            positions[i]  = p[i].position;
+            velocities[i] = p[i].velocity;
+            fitness[i]    = p[i].fitness;
+        }
+
+        for(int i = 0; i < 2; ++i)
+        {
+            const GLvoid* initial = i == 0 ? positions.data() : nullptr;
+
+            glBindBuffer(GL_ARRAY_BUFFER, positionBuffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, SWARM_SIZE * sizeof(glm::vec3),
+                         initial, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_ARRAY_BUFFER, bestPositionBuffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, SWARM_SIZE * sizeof(glm::vec3),
+                         initial, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_ARRAY_BUFFER, velocityBuffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, SWARM_SIZE * sizeof(glm::vec3),
+                         i == 0 ? velocities.data() : nullptr,
+                         GL_DYNAMIC_COPY);
+        }
+
+        fitnessBuffer.upload(fitness.data(), SWARM_SIZE);
+    }
+    else
+    {
+        for(int i = 0; i < 2; ++i)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, positionBuffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, SWARM_SIZE * sizeof(Particle),
+                         i == 0 ? p.data() : nullptr, GL_DYNAMIC_COPY);
+        }
+    }
+
+    GlobalBest globalBest = { bestPosition, f(bestPosition) };
+    simgll::Buffer<GlobalBest> globalBestBuffer(1, 0, &globalBest);
+
+    // Only the global best is read back, for display
+    simgll::ReadbackQueue readback(sizeof(GlobalBest));
 
     const glm::vec3 particleGeometry[] =
     {
@@ -194,14 +304,14 @@ int main()
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
         glEnableVertexAttribArray(0);
 
-        glBindBuffer(GL_ARRAY_BUFFER, psoBuffers[i]);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Particle),
-                              nullptr);
+        glBindBuffer(GL_ARRAY_BUFFER, positionBuffers[i]);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
         glEnableVertexAttribArray(1);
         glVertexAttribDivisor(1, 1);
 
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Particle),
-                              (GLvoid*)sizeof(glm::vec4));
+        glBindBuffer(GL_ARRAY_BUFFER, velocityBuffers[i]);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride,
+                              (GLvoid*)velocityOffset);
         glEnableVertexAttribArray(2);
         glVertexAttribDivisor(2, 1);
     }
@@ -220,7 +330,63 @@ int main()
     GLuint frameIndex = 0;
     GLfloat omega = 0.9F;
 
-    while(!glfwWindowShouldClose(window))
+    // Reference for the first iteration computed by the multi-threaded CPU
+    // backend, from the same initial swarm, global best and random streams
+    std::vector<simgll::cpu::Particle> reference(SWARM_SIZE);
+    {
+        std::vector<simgll::cpu::Particle> initial(SWARM_SIZE);
+
+        for(int j = 0; j < SWARM_SIZE; ++j)
+        {
+            for(int d = 0; d < 3; ++d)
+            {
+                initial[j].position[d]     = p[j].position[d];
+                initial[j].velocity[d]     = p[j].velocity[d];
+                initial[j].bestPosition[d] = p[j].bestPosition[d];
+            }
+
+            initial[j].fitness = p[j].fitness;
+        }
+
+        simgll::cpu::GlobalBest best =
+        {
+            { globalBest.position.x, globalBest.position.y,
+              globalBest.position.z },
+            globalBest.fitness
+        };
+
+        simgll::cpu::psoUpdate(objective, dimensions, initial.data(),
+                               reference.data(), SWARM_SIZE, best, omega,
+                               static_cast<GLuint>(seed), INIT_COUNTERS);
+    }
+
+    // Positions are read with the stride of either layout, the fitness
+    // stream is packed in both
+    simgll::ReadbackQueue check(SWARM_SIZE * sizeof(Particle), 2);
+    std::size_t mismatches = 0;
+
+    const std::size_t recordFloats = sizeof(simgll::cpu::Particle) / sizeof(GLfloat);
+
+    auto checkPositions = [&](const GLvoid* data, GLsizeiptr)
+    {
+        mismatches += simgll::cpu::countMismatches(
+            static_cast<const GLfloat*>(data), stride / sizeof(GLfloat),
+            reference[0].position, recordFloats, SWARM_SIZE, dimensions,
+            CHECK_TOLERANCE);
+    };
+
+    auto checkFitness = [&](const GLvoid* data, GLsizeiptr)
+    {
+        mismatches += simgll::cpu::countMismatches(
+            static_cast<const GLfloat*>(data), 1,
+            &reference[0].fitness, recordFloats, SWARM_SIZE, 1,
+            CHECK_TOLERANCE);
+
+        std::cout << "First iteration: " << mismatches
+                  << " mismatches against the CPU backend\n";
+    };
+
+    while(!context.shouldClose())
     {
         currentTime = (GLfloat) glfwGetTime();
         deltaTime   = currentTime - oldTime;
@@ -231,32 +397,56 @@ int main()
         {
             psoProgram.use();
 
-            glUniform1f(omegaLocation, omega);
-            glUniform3f(bestPositionLocation, bestPosition.x, bestPosition.y, bestPosition.z);
-            glUniform1ui(cpuSeedLocation, rand());
+            psoProgram.set(omegaLocation, omega);
+            psoProgram.set(seedLocation, static_cast<GLuint>(seed));
+            psoProgram.set(counterLocation, INIT_COUNTERS + static_cast<GLuint>(i));
 
             // Bind buffers for compute shader
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, psoBuffers[frameIndex]);
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, psoBuffers[frameIndex ^ 1]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionBuffers[frameIndex]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, positionBuffers[frameIndex ^ 1]);
+            globalBestBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+            fitnessBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, velocityBuffers[frameIndex]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, velocityBuffers[frameIndex ^ 1]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, bestPositionBuffers[frameIndex]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, bestPositionBuffers[frameIndex ^ 1]);
 
             glDispatchCompute(NUM_WORKGROUPS, 1, 1);
 
-            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-            glBindBuffer(GL_ARRAY_BUFFER, psoBuffers[frameIndex ^ 1]);
-            p = reinterpret_cast<Particle*>(glMapBufferRange(GL_ARRAY_BUFFER,
-                                                             0, SWARM_SIZE *
-                                                             sizeof(Particle),
-                                                             GL_MAP_READ_BIT));
-
-            glm::vec3 currentBestPosition = getBestPosition(p);
-
-            if(f(currentBestPosition) < f(bestPosition))
+            if(i == 0)
             {
-                bestPosition = currentBestPosition;
+                check.enqueue(positionBuffers[frameIndex ^ 1], 0,
+                              SWARM_SIZE * stride, checkPositions);
+                check.enqueue(fitnessBuffer.name(), 0,
+                              SWARM_SIZE * sizeof(GLfloat), checkFitness);
             }
 
-            glUnmapBuffer(GL_ARRAY_BUFFER);
+            // Update the global best without leaving the GPU, the next
+            // dispatch reads it straight from globalBestBuffer
+            argmin.run(fitnessBuffer.name(), SWARM_SIZE,
+                       candidateBuffer.name());
+
+            globalBestProgram.use();
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionBuffers[frameIndex ^ 1]);
+            candidateBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+            globalBestBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+
+            glDispatchCompute(1, 1, 1);
+
+            // The new swarm is read by the next iteration as a storage
+            // buffer and by the draw as vertex attributes
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT |
+                            GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+            // The displayed value arrives a few iterations later
+            readback.enqueue(globalBestBuffer.name(), 0, sizeof(GlobalBest),
+                             [&](const GLvoid* data, GLsizeiptr)
+            {
+                bestPosition = static_cast<const GlobalBest*>(data)->position;
+            });
 
             omega -= (0.9F - 0.4F) / NUM_ITER;
             totalTime = 0.0F;
@@ -264,7 +454,10 @@ int main()
             i++;
         }
 
-        glfwPollEvents();
+        readback.poll();
+        check.poll();
+
+        context.pollEvents();
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -285,7 +478,7 @@ int main()
                     bestPosition.x, bestPosition.y, bestPosition.z);
         ImGui::Text("Best Fitness = %f", f(bestPosition));
 
-        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &mvp[0][0]);
+        renderProgram.set(mvpLocation, mvp);
 
         glBindVertexArray(renderVaos[frameIndex]);
         glDrawArraysInstanced(GL_POINTS, 0, 1, SWARM_SIZE);
@@ -296,27 +489,25 @@ int main()
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
-        glfwSwapBuffers(window);
+        context.swapBuffers();
     }
 
-    glfwTerminate();
-
     return 0;
 }
 
-glm::vec3 getBestPosition(Particle* p)
+glm::vec3 getBestPosition(const Particle* p)
 {
-    glm::vec3 bestPosition = p[0].position;
+    int best = 0;
 
     for(int i = 1; i < SWARM_SIZE; i++)
     {
-        if(p[i].fitness < p[i - 1].fitness)
+        if(p[i].fitness < p[best].fitness)
         {
-            bestPosition = p[i].position;
+            best = i;
         }
     }
 
-    return bestPosition;
+    return p[best].position;
 }
 
 GLvoid error_callback(GLint error, const GLchar* description)
@@ -324,27 +515,3 @@ GLvoid error_callback(GLint error, const GLchar* description)
     std::cerr << "GLFW error " << error << ": " << description << "\n";
     exit(1);
 }
-
-// Global minimum = f(0, -1) = 3
-// Search domain = -2.0 <= pi <= 2.0
-GLfloat goldsteinPrice(glm::vec2 p)
-{
-    return (1  + (p.x + p.y + 1) * (p.x + p.y + 1) *
-           (19 - 14 * p.x + 3 * p.x * p.x - 14 * p.y + 6 * p.x * p.y + 3 * p.y * p.y)) *
-           (30 + (2 * p.x - 3 * p.y) * (2 * p.x - 3 * p.y) *
-           (18 - 32 * p.x + 12 * p.x * p.x + 48 * p.y - 36 * p.x * p.y + 27 * p.y * p.y));
-}
-
-// Global minimum = f(0, ..., 0) = 0
-// Search domain  = -5.12 <= pi <= 5.12
-GLfloat rastrigin3D(const glm::vec3& p)
-{
-    constexpr int a = 10;
-    float s = a * 3.0F;
-
-    s += p.x * p.x - a * cosf(2 * PI * p.x);
-    s += p.y * p.y - a * cosf(2 * PI * p.y);
-    s += p.z * p.z - a * cosf(2 * PI * p.z);
-
-    return s;
-}
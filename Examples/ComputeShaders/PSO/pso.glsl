@@ -1,10 +1,17 @@
 #version 450 core
 
+// DIM, LOWER, UPPER and objective() are injected by the host from the
+// selected simgll::Objective, philox() and uniform_float() from
+// simgll::philoxGlsl(), and SOA_LAYOUT when the swarm is stored as separate
+// position, velocity and best position streams
+
 layout (local_size_x = 16) in;
 
 uniform float omega;
-uniform vec3 bestPosition;
-uniform uint cpuSeed;
+
+// The counter is different for every iteration
+uniform uint seed;
+uniform uint counter;
 
 struct Particle
 {
@@ -14,80 +21,146 @@ struct Particle
     float fitness;
 };
 
+// Global best, kept up to date on the GPU by global_best.glsl
+layout (std430, binding = 2) readonly buffer globalBest
+{
+    vec3 position;
+    float fitness;
+} best;
+
+#ifdef SOA_LAYOUT
+// Every stream is tightly packed, the fitness stream is the input of the
+// argmin reduction too and it is updated in place
+layout (std430, binding = 0) readonly buffer inPositions
+{
+    float positions[];
+} inPosition;
+
+layout (std430, binding = 1) writeonly buffer outPositions
+{
+    float positions[];
+} outPosition;
+
+layout (std430, binding = 3) buffer swarmFitness
+{
+    float fitness[];
+};
+
+layout (std430, binding = 4) readonly buffer inVelocities
+{
+    float velocities[];
+} inVelocity;
+
+layout (std430, binding = 5) writeonly buffer outVelocities
+{
+    float velocities[];
+} outVelocity;
+
+layout (std430, binding = 6) readonly buffer inBestPositions
+{
+    float bestPositions[];
+} inBestPosition;
+
+layout (std430, binding = 7) writeonly buffer outBestPositions
+{
+    float bestPositions[];
+} outBestPosition;
+
+Particle loadParticle(int i)
+{
+    Particle p;
+    p.position     = vec3(inPosition.positions[3 * i],
+                          inPosition.positions[3 * i + 1],
+                          inPosition.positions[3 * i + 2]);
+    p.velocity     = vec3(inVelocity.velocities[3 * i],
+                          inVelocity.velocities[3 * i + 1],
+                          inVelocity.velocities[3 * i + 2]);
+    p.bestPosition = vec3(inBestPosition.bestPositions[3 * i],
+                          inBestPosition.bestPositions[3 * i + 1],
+                          inBestPosition.bestPositions[3 * i + 2]);
+    p.fitness      = fitness[i];
+
+    return p;
+}
+
+void storeParticle(int i, Particle p)
+{
+    for(int d = 0; d < 3; d++)
+    {
+        outPosition.positions[3 * i + d]         = p.position[d];
+        outVelocity.velocities[3 * i + d]        = p.velocity[d];
+        outBestPosition.bestPositions[3 * i + d] = p.bestPosition[d];
+    }
+
+    fitness[i] = p.fitness;
+}
+#else
 layout (std430, binding = 0) readonly buffer inSwarm
 {
     Particle particles[];
 } inputData;
 
-layout (std430, binding = 1) buffer outSwarm
+layout (std430, binding = 1) writeonly buffer outSwarm
 {
     Particle particles[];
 } outputData;
 
-float goldsteinPrice(vec3 p)
+// Packed copy of the new fitness values, the input of the argmin reduction
+layout (std430, binding = 3) writeonly buffer swarmFitness
 {
-    return (1  + (p.x + p.y + 1) * (p.x + p.y + 1) *
-           (19 - 14 * p.x + 3 * p.x * p.x - 14 * p.y + 6 * p.x * p.y + 3 * p.y * p.y)) *
-           (30 + (2 * p.x - 3 * p.y) * (2 * p.x - 3 * p.y) *
-           (18 - 32 * p.x + 12 * p.x * p.x + 48 * p.y - 36 * p.x * p.y + 27 * p.y * p.y));
-}
+    float fitness[];
+};
 
-float rastrigin3D(vec3 p)
+Particle loadParticle(int i)
 {
-    int a = 10;
-    float s = a * 3.0F;
-    float PI = 3.1415926535;
-
-    s += p.x * p.x - a * cos(2 * PI * p.x);
-    s += p.y * p.y - a * cos(2 * PI * p.y);
-    s += p.z * p.z - a * cos(2 * PI * p.z);
+    return inputData.particles[i];
+}
 
-    return s;
+void storeParticle(int i, Particle p)
+{
+    outputData.particles[i] = p;
+    fitness[i] = p.fitness;
 }
+#endif
 
-uvec2 tea(uvec2 v, int rounds)
+// objective() takes DIM (2 or 3) coordinates
+float evaluate(vec3 p)
 {
-    const uvec4 key = {0xa341316c, 0xc8013ea4, 0xad90777d, 0x7e95761e};
-    const uint delta = 0x9e3779b9;
-    uint sum = 0;
+    float x[DIM];
 
-    for(int i = 0; i < rounds; i++)
+    for(int i = 0; i < DIM; i++)
     {
-        sum += delta;
-        v[0] += ((v[1] << 4) + key[0]) ^ (v[1] + sum) ^ ((v[1] >> 5) + key[1]);
-        v[1] += ((v[0] << 4) + key[2]) ^ (v[0] + sum) ^ ((v[0] >> 5) + key[3]);
+        x[i] = p[i];
     }
 
-    return v;
+    return objective(x);
 }
 
 void main()
 {
     int globalId = int(gl_GlobalInvocationID.x);
 
-    Particle pIn  = inputData.particles[globalId];
+    Particle pIn  = loadParticle(globalId);
     Particle pOut;
 
-    uvec2 seed = gl_GlobalInvocationID.xy * cpuSeed;
-    uvec2 rand = tea(seed, 5);
+    uvec4 rand = philox(seed, uint(globalId), counter);
 
-    float k1 = float(rand[0]) / 4294967296.0;
-    float k2 = float(rand[1]) / 4294967296.0;
+    float k1 = uniform_float(rand.x);
+    float k2 = uniform_float(rand.y);
 
     pOut.velocity = omega * pIn.velocity +
         2.0 * k1 * (pIn.bestPosition - pIn.position) +
-        2.0 * k2 * (bestPosition - pIn.position);
+        2.0 * k2 * (best.position - pIn.position);
 
     float speed = length(pOut.velocity);
 
-    if(speed > 4)
+    if(speed > UPPER - LOWER)
     {
-        pOut.velocity = 4 * normalize(pOut.velocity);
+        pOut.velocity = (UPPER - LOWER) * normalize(pOut.velocity);
     }
 
     pOut.position = pIn.position + pOut.velocity;
-    pOut.fitness  = goldsteinPrice(pOut.position);
-    /*pOut.fitness = rastrigin3D(pOut.position);*/
+    pOut.fitness  = evaluate(pOut.position);
 
     if(pOut.fitness < pIn.fitness)
     {
@@ -98,5 +171,5 @@ void main()
         pOut.bestPosition = pIn.bestPosition;
     }
 
-    outputData.particles[globalId] = pOut;
+    storeParticle(globalId, pOut);
 }
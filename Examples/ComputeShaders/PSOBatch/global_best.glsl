@@ -0,0 +1,70 @@
+#version 450 core
+
+// DIM is injected by the host from the selected simgll::Objective
+
+layout (local_size_x = 64) in;
+
+uniform uint numRuns;
+uniform uint iteration;
+
+struct Particle
+{
+    float position[DIM];
+    float velocity[DIM];
+    float bestPosition[DIM];
+    float bestFitness;
+};
+
+struct Candidate
+{
+    float fitness;
+    uint index;
+};
+
+struct GlobalBest
+{
+    float position[DIM];
+    float fitness;
+};
+
+layout (std430, binding = 0) readonly buffer swarm
+{
+    Particle particles[];
+} swarmData;
+
+// Fittest particle of every run, written by the segmented argmin reduction
+layout (std430, binding = 1) readonly buffer bestCandidates
+{
+    Candidate runs[];
+} candidates;
+
+layout (std430, binding = 2) buffer globalBest
+{
+    GlobalBest runs[];
+} best;
+
+// Best fitness of every run after every iteration, read once at the end
+layout (std430, binding = 3) writeonly buffer convergence
+{
+    float history[];
+};
+
+void main()
+{
+    uint run = gl_GlobalInvocationID.x;
+
+    if(run >= numRuns)
+    {
+        return;
+    }
+
+    Candidate candidate = candidates.runs[run];
+
+    if(candidate.fitness < best.runs[run].fitness)
+    {
+        best.runs[run].position = swarmData.particles[candidate.index].position;
+        best.runs[run].fitness  = candidate.fitness;
+    }
+
+    history[iteration * numRuns + run] = best.runs[run].fitness;
+}
@@ -0,0 +1,62 @@
+#version 450 core
+
+// DIM, LOWER, UPPER and objective() are injected by the host from the
+// selected simgll::Objective, philox() and uniform_float() from
+// simgll::philoxGlsl()
+
+#define VMAX (0.2 * (UPPER - LOWER))
+
+layout (local_size_x = 256) in;
+
+uniform uint numParticles;
+
+// The initial swarm uses the counters of iteration 0, one per dimension
+uniform uint seed;
+
+struct Particle
+{
+    float position[DIM];
+    float velocity[DIM];
+    float bestPosition[DIM];
+    float bestFitness;
+};
+
+layout (std430, binding = 0) writeonly buffer outSwarm
+{
+    Particle particles[];
+} outputData;
+
+layout (std430, binding = 1) writeonly buffer swarmFitness
+{
+    float fitness[];
+};
+
+void main()
+{
+    // Swarms larger than 65535 workgroups are dispatched in two dimensions
+    uint globalId = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) *
+                    gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+
+    if(globalId >= numParticles)
+    {
+        return;
+    }
+
+    // Positions are uniform in the search domain, velocities in
+    // [-VMAX, VMAX]
+    Particle p;
+
+    for(int d = 0; d < DIM; d++)
+    {
+        vec2 k = uniform_float(philox(seed, globalId, uint(d))).xy;
+
+        p.position[d]     = LOWER + k.x * (UPPER - LOWER);
+        p.velocity[d]     = (2.0 * k.y - 1.0) * VMAX;
+        p.bestPosition[d] = p.position[d];
+    }
+
+    p.bestFitness = objective(p.position);
+
+    outputData.particles[globalId] = p;
+    fitness[globalId] = p.bestFitness;
+}
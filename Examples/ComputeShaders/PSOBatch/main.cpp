@@ -0,0 +1,286 @@
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <GL/glew.h>
+
+#include "buffer.h"
+#include "compute.h"
+#include "context.h"
+#include "objective.h"
+#include "random.h"
+#include "readback.h"
+#include "shaderprogram.h"
+
+constexpr GLuint WIDTH          = 512;
+constexpr GLuint HEIGHT         = 512;
+constexpr GLuint WORKGROUP_SIZE = 256;
+constexpr GLuint MERGE_SIZE     = 64;
+
+// Defaults, all of them can be overridden from the command line:
+// PSOBatch [objective] [dimensions] [particles per run] [runs] [iterations]
+constexpr const char* OBJECTIVE = "rastrigin";
+constexpr GLuint DIMENSIONS     = 10;
+constexpr GLuint SWARM_SIZE     = 1 << 16;
+constexpr GLuint NUM_RUNS       = 16;
+constexpr GLuint NUM_ITER       = 1000;
+
+GLvoid dispatch(GLuint groups);
+
+int main(int argc, char* argv[])
+{
+    const simgll::Objective& objective =
+        simgll::findObjective(argc > 1 ? argv[1] : OBJECTIVE);
+
+    GLuint dimensions = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : DIMENSIONS;
+    GLuint swarmSize  = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : SWARM_SIZE;
+    GLuint numRuns    = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : NUM_RUNS;
+    GLuint numIter    = argc > 5 ? std::strtoul(argv[5], nullptr, 10) : NUM_ITER;
+
+    if(objective.dimensions != 0)
+    {
+        dimensions = objective.dimensions;
+    }
+
+    GLuint numParticles = swarmSize * numRuns;
+
+    if(dimensions == 0 || swarmSize == 0 || numRuns == 0 ||
+       static_cast<GLuint64>(swarmSize) * numRuns > 0xFFFFFFFFU)
+    {
+        std::cerr << "Invalid dimensions, swarm size or number of runs\n";
+
+        exit(1);
+    }
+
+    // A particle is position, velocity and best position followed by the
+    // best fitness, a global best is a position followed by its fitness
+    GLuint particleFloats = 3 * dimensions + 1;
+    GLuint bestFloats     = dimensions + 1;
+
+    // Batch mode runs as fast as the GPU allows, there is nothing to show
+    simgll::Context context(simgll::Context::Type::Headless, WIDTH, HEIGHT,
+                            "PSO Batch", 4, 5);
+
+    // The objective is generated into every program, switching it doesn't
+    // require editing any shader
+    std::string header = objective.glsl(dimensions) + simgll::philoxGlsl();
+
+    simgll::ShaderProgram initProgram;
+    initProgram.addShader("init.glsl", GL_COMPUTE_SHADER, header);
+    initProgram.compileAsync();
+
+    simgll::ShaderProgram psoProgram;
+    psoProgram.addShader("pso.glsl", GL_COMPUTE_SHADER, header);
+    psoProgram.compileAsync();
+
+    simgll::ShaderProgram globalBestProgram;
+    globalBestProgram.addShader("global_best.glsl", GL_COMPUTE_SHADER, header);
+    globalBestProgram.compileAsync();
+
+    // One argmin per run, every run is a segment of the fitness buffer
+    simgll::compute::ArgReduce argmin(simgll::compute::Type::Float,
+                                      simgll::compute::Op::Min);
+
+    GLsizeiptr swarmFloats = static_cast<GLsizeiptr>(numParticles) *
+                             particleFloats;
+
+    simgll::Buffer<GLfloat> swarmBuffers[2] =
+    {
+        simgll::Buffer<GLfloat>(swarmFloats),
+        simgll::Buffer<GLfloat>(swarmFloats)
+    };
+
+    simgll::Buffer<GLfloat> fitnessBuffer(numParticles);
+    simgll::Buffer<GLuint> candidateBuffer(2 * numRuns);
+
+    std::vector<GLfloat> initialBest(numRuns * bestFloats, 0.0F);
+
+    for(GLuint r = 0; r < numRuns; r++)
+    {
+        initialBest[r * bestFloats + dimensions] =
+            std::numeric_limits<float>::infinity();
+    }
+
+    simgll::Buffer<GLfloat> globalBestBuffer(numRuns * bestFloats, 0,
+                                             initialBest.data());
+
+    // Row 0 holds the best fitness of the initial swarms
+    simgll::Buffer<GLfloat> historyBuffer((numIter + 1) * numRuns);
+
+    GLuint seed = std::random_device{}();
+    GLuint groups = (numParticles + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+
+    // updateGlobalBest() runs every iteration, its uniforms are looked up
+    // once
+    GLint numRunsLocation       = globalBestProgram.getLocation("numRuns");
+    GLint bestIterationLocation = globalBestProgram.getLocation("iteration");
+
+    auto updateGlobalBest = [&](GLuint swarm, GLuint iteration)
+    {
+        argmin.run(fitnessBuffer.name(), numParticles, candidateBuffer.name(),
+                   0, numRuns);
+
+        globalBestProgram.use();
+        globalBestProgram.set(numRunsLocation, numRuns);
+        globalBestProgram.set(bestIterationLocation, iteration);
+
+        swarmBuffers[swarm].bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+        candidateBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+        globalBestBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+        historyBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+
+        glDispatchCompute((numRuns + MERGE_SIZE - 1) / MERGE_SIZE, 1, 1);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    };
+
+    // The initial swarms are generated on the GPU too
+    initProgram.use();
+    initProgram.set(initProgram.getLocation("numParticles"), numParticles);
+    initProgram.set(initProgram.getLocation("seed"), seed);
+
+    swarmBuffers[0].bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+    fitnessBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+
+    dispatch(groups);
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    updateGlobalBest(0, 0);
+
+    GLint numParticlesLocation = psoProgram.getLocation("numParticles");
+    GLint swarmSizeLocation    = psoProgram.getLocation("swarmSize");
+    GLint seedLocation         = psoProgram.getLocation("seed");
+    GLint omegaLocation        = psoProgram.getLocation("omega");
+    GLint iterationLocation    = psoProgram.getLocation("iteration");
+
+    psoProgram.use();
+    psoProgram.set(numParticlesLocation, numParticles);
+    psoProgram.set(swarmSizeLocation, swarmSize);
+
+    psoProgram.set(seedLocation, seed);
+
+    GLuint frameIndex = 0;
+    GLfloat omega = 0.9F;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Iterations are queued back to back, the host never waits on the GPU
+    for(GLuint i = 1; i <= numIter; i++)
+    {
+        psoProgram.use();
+        psoProgram.set(omegaLocation, omega);
+        psoProgram.set(iterationLocation, i);
+
+        swarmBuffers[frameIndex].bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+        swarmBuffers[frameIndex ^ 1].bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+        globalBestBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+        fitnessBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+
+        dispatch(groups);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        updateGlobalBest(frameIndex ^ 1, i);
+
+        omega -= (0.9F - 0.4F) / numIter;
+        frameIndex ^= 1;
+    }
+
+    simgll::ReadbackQueue readback(std::max(bestFloats, numIter + 1) *
+                                   numRuns * sizeof(GLfloat), 1);
+
+    std::vector<GLfloat> finalBest(numRuns * bestFloats);
+
+    readback.enqueue(globalBestBuffer.name(), 0,
+                     numRuns * bestFloats * sizeof(GLfloat),
+                     [&](const GLvoid* data, GLsizeiptr size)
+    {
+        std::copy_n(static_cast<const GLfloat*>(data), size / sizeof(GLfloat),
+                    finalBest.begin());
+    });
+
+    readback.flush();
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    // Convergence curves: best, mean and worst global best across runs
+    std::ofstream csv("convergence.csv");
+    csv << "iteration,min,mean,max\n";
+
+    readback.enqueue(historyBuffer.name(), 0,
+                     (numIter + 1) * numRuns * sizeof(GLfloat),
+                     [&](const GLvoid* data, GLsizeiptr)
+    {
+        const GLfloat* history = static_cast<const GLfloat*>(data);
+
+        for(GLuint i = 0; i <= numIter; i++)
+        {
+            const GLfloat* row = history + i * numRuns;
+            double sum = 0.0;
+
+            for(GLuint r = 0; r < numRuns; r++)
+            {
+                sum += row[r];
+            }
+
+            csv << i << ","
+                << *std::min_element(row, row + numRuns) << ","
+                << sum / numRuns << ","
+                << *std::max_element(row, row + numRuns) << "\n";
+        }
+    });
+
+    readback.flush();
+
+    GLuint bestRun = 0;
+
+    for(GLuint r = 1; r < numRuns; r++)
+    {
+        if(finalBest[r * bestFloats + dimensions] <
+           finalBest[bestRun * bestFloats + dimensions])
+        {
+            bestRun = r;
+        }
+    }
+
+    const GLfloat* bestPosition = &finalBest[bestRun * bestFloats];
+
+    double updates = static_cast<double>(numParticles) * numIter;
+
+    std::cout << objective.name << " in " << dimensions << " dimensions, "
+              << numRuns << " runs x " << swarmSize << " particles, "
+              << numIter << " iterations\n";
+
+    // The CPU implementation of the objective validates the GPU fitness
+    std::cout << "Best fitness = " << bestPosition[dimensions]
+              << " (CPU " << objective.evaluate(bestPosition, dimensions)
+              << ", global minimum " << objective.minimum << ")\n";
+
+    std::cout << "Best position = (";
+
+    for(GLuint d = 0; d < dimensions; d++)
+    {
+        std::cout << (d ? ", " : "") << bestPosition[d];
+    }
+
+    std::cout << ")\n";
+    std::cout << "Elapsed = " << elapsed.count() << " s, "
+              << updates / elapsed.count() << " particle updates/s\n";
+    std::cout << "Convergence curves written to convergence.csv\n";
+
+    return 0;
+}
+
+GLvoid dispatch(GLuint groups)
+{
+    GLuint x = std::min(groups, 65535U);
+
+    glDispatchCompute(x, (groups + x - 1) / x, 1);
+}
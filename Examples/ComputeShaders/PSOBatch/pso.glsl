@@ -0,0 +1,93 @@
+#version 450 core
+
+// DIM, LOWER, UPPER and objective() are injected by the host from the
+// selected simgll::Objective, philox() and uniform_float() from
+// simgll::philoxGlsl()
+
+#define VMAX (0.2 * (UPPER - LOWER))
+
+layout (local_size_x = 256) in;
+
+uniform float omega;
+uniform uint numParticles;
+uniform uint swarmSize;
+
+// One counter per dimension and iteration, iteration 0 is init.glsl
+uniform uint seed;
+uniform uint iteration;
+
+struct Particle
+{
+    float position[DIM];
+    float velocity[DIM];
+    float bestPosition[DIM];
+    float bestFitness;
+};
+
+struct GlobalBest
+{
+    float position[DIM];
+    float fitness;
+};
+
+layout (std430, binding = 0) readonly buffer inSwarm
+{
+    Particle particles[];
+} inputData;
+
+layout (std430, binding = 1) writeonly buffer outSwarm
+{
+    Particle particles[];
+} outputData;
+
+// One global best per run, the swarms of the runs are stored back to back
+layout (std430, binding = 2) readonly buffer globalBest
+{
+    GlobalBest runs[];
+} best;
+
+layout (std430, binding = 3) writeonly buffer swarmFitness
+{
+    float fitness[];
+};
+
+void main()
+{
+    // Swarms larger than 65535 workgroups are dispatched in two dimensions
+    uint globalId = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) *
+                    gl_WorkGroupSize.x + gl_LocalInvocationID.x;
+
+    if(globalId >= numParticles)
+    {
+        return;
+    }
+
+    Particle p = inputData.particles[globalId];
+    uint run = globalId / swarmSize;
+
+    for(int d = 0; d < DIM; d++)
+    {
+        uvec4 rand = philox(seed, globalId, iteration * uint(DIM) + uint(d));
+
+        float k1 = uniform_float(rand.x);
+        float k2 = uniform_float(rand.y);
+
+        float velocity = omega * p.velocity[d] +
+            2.0 * k1 * (p.bestPosition[d] - p.position[d]) +
+            2.0 * k2 * (best.runs[run].position[d] - p.position[d]);
+
+        p.velocity[d] = clamp(velocity, -VMAX, VMAX);
+        p.position[d] = clamp(p.position[d] + p.velocity[d], LOWER, UPPER);
+    }
+
+    float f = objective(p.position);
+
+    if(f < p.bestFitness)
+    {
+        p.bestPosition = p.position;
+        p.bestFitness  = f;
+    }
+
+    outputData.particles[globalId] = p;
+    fitness[globalId] = f;
+}
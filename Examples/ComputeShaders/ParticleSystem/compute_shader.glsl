@@ -1,27 +1,96 @@
 #version 430 core
 
-layout (std140, binding = 0) uniform attractor_block
+// LOCAL_SIZE, POSITION_FORMAT and VELOCITY_FORMAT are injected by the
+// host, and QUANTIZED_POSITION when positions are stored normalized to the
+// bounding box. The image formats convert the values on load and store.
+
+layout (std430, binding = 0) readonly buffer attractor_block
+{
+    vec4 attractor[]; // xyz = position, w = mass
+};
+
+// Number of attractors in attractor_block
+uniform uint attractor_count = 0;
+
+// Process particles in blocks of LOCAL_SIZE, every block walks the
+// attractors in tiles of LOCAL_SIZE staged in shared memory
+layout (local_size_x = LOCAL_SIZE) in;
+
+shared vec4 attractor_tile[gl_WorkGroupSize.x];
+
+// Only the particles of the alive list are updated, the dispatch is sized
+// by dispatch_args.glsl. Survivors are appended to the other alive list,
+// which is the one drawn, and expired particles to the dead list.
+struct draw_command
+{
+    uint count;
+    uint instance_count;
+    uint first;
+    uint base_instance;
+};
+
+layout (std430, binding = 1) buffer particle_counters
+{
+    draw_command draw[2];   // count = length of each alive list
+    uvec3 dispatch_groups;
+    uint dead_count;
+};
+
+layout (std430, binding = 2) readonly buffer alive_in
+{
+    uint alive_index[];
+} input_list;
+
+layout (std430, binding = 3) writeonly buffer alive_out
+{
+    uint alive_index[];
+} output_list;
+
+layout (std430, binding = 4) writeonly buffer dead_list
 {
-    vec4 attractor[64]; // xyz = position, w = mass
+    uint dead_index[];
 };
 
-// Process particles in blocks of 128
-layout (local_size_x = 128) in;
+// Alive list read this frame
+uniform uint current = 0;
 
 // Buffers containing the position and velocities of the particles
-layout (rgba32f, binding = 0) uniform imageBuffer positionBuffer;
-layout (rgba32f, binding = 1) uniform imageBuffer velocityBuffer;
+layout (POSITION_FORMAT, binding = 0) uniform imageBuffer positionBuffer;
+layout (VELOCITY_FORMAT, binding = 1) uniform imageBuffer velocityBuffer;
 
 // Delta time
 uniform float dt = 1.0;
 
+// Quantized positions cover this box, particles leaving it are clamped
+uniform vec3 bounds_min = vec3(-128.0);
+uniform vec3 bounds_max = vec3(128.0);
+
+vec4 load_position(int i)
+{
+    vec4 pos = imageLoad(positionBuffer, i);
+#ifdef QUANTIZED_POSITION
+    pos.xyz = mix(bounds_min, bounds_max, pos.xyz);
+#endif
+    return pos;
+}
+
+void store_position(int i, vec4 pos)
+{
+#ifdef QUANTIZED_POSITION
+    pos.xyz = (pos.xyz - bounds_min) / (bounds_max - bounds_min);
+#endif
+    imageStore(positionBuffer, i, pos);
+}
+
 void main()
 {
-    // Read the current position and velocity from the buffers
-    vec4 vel = imageLoad(velocityBuffer, int(gl_GlobalInvocationID.x));
-    vec4 pos = imageLoad(positionBuffer, int(gl_GlobalInvocationID.x));
+    // Invocations past the end of the list still help loading attractors
+    bool alive = gl_GlobalInvocationID.x < draw[current].count;
+    int index  = alive ? int(input_list.alive_index[gl_GlobalInvocationID.x]) : 0;
 
-    int i;
+    // Read the current position and velocity from the buffers
+    vec4 vel = imageLoad(velocityBuffer, index);
+    vec4 pos = load_position(index);
 
     // Update position using current velocity * time
     pos.xyz += vel.xyz * dt;
@@ -29,23 +98,43 @@ void main()
     // Update "life" of particle in w component
     pos.w -= 0.0001 * dt;
 
-    // For each attractor ...
-    for(i = 0; i < 4; i++)
+    // For each tile of attractors ...
+    for(uint first = 0; first < attractor_count; first += gl_WorkGroupSize.x)
     {
-        // Calculate force and update velocity accordingly
-        vec3 dist = (attractor[i].xyz - pos.xyz);
-        vel.xyz += dt * dt * attractor[i].w * normalize(dist) / (dot(dist, dist) + 10.0);
+        // ... every invocation loads one of them ...
+        uint j = first + gl_LocalInvocationID.x;
+        attractor_tile[gl_LocalInvocationID.x] = j < attractor_count ? attractor[j] : vec4(0.0);
+        barrier();
+
+        uint count = min(gl_WorkGroupSize.x, attractor_count - first);
+
+        // ... and the whole workgroup reads them from shared memory
+        for(uint i = 0; i < count; i++)
+        {
+            // Calculate force and update velocity accordingly
+            vec3 dist = (attractor_tile[i].xyz - pos.xyz);
+            vel.xyz += dt * dt * attractor_tile[i].w * normalize(dist) / (dot(dist, dist) + 10.0);
+        }
+
+        barrier();
+    }
+
+    if(!alive)
+    {
+        return;
     }
 
-    // If the particle expires, reset it
+    // If the particle expires, its slot is recycled by emit.glsl
     if(pos.w <= 0.0)
     {
-        pos.xyz  = -pos.xyz * 0.01;
-        vel.xyz *= 0.01;
-        pos.w   += 1.0f;
+        dead_index[atomicAdd(dead_count, 1u)] = uint(index);
+
+        return;
     }
 
+    output_list.alive_index[atomicAdd(draw[current ^ 1u].count, 1u)] = uint(index);
+
     // Store the new position and velocity back into the buffers
-    imageStore(positionBuffer, int(gl_GlobalInvocationID.x), pos);
-    imageStore(velocityBuffer, int(gl_GlobalInvocationID.x), vel);
+    store_position(index, pos);
+    imageStore(velocityBuffer, index, vel);
 }
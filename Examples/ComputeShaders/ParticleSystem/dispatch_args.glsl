@@ -0,0 +1,32 @@
+#version 430 core
+
+// LOCAL_SIZE is injected by the host
+
+layout (local_size_x = 1) in;
+
+struct draw_command
+{
+    uint count;
+    uint instance_count;
+    uint first;
+    uint base_instance;
+};
+
+layout (std430, binding = 1) buffer particle_counters
+{
+    draw_command draw[2];
+    uvec3 dispatch_groups;
+    uint dead_count;
+};
+
+uniform uint current = 0;
+
+// Sizes the update of the alive list current and empties the list it
+// appends the survivors to
+void main()
+{
+    uint count = draw[current].count;
+
+    dispatch_groups = uvec3((count + LOCAL_SIZE - 1u) / LOCAL_SIZE, 1u, 1u);
+    draw[current ^ 1u].count = 0u;
+}
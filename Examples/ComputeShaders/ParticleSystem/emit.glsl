@@ -0,0 +1,91 @@
+#version 430 core
+
+// LOCAL_SIZE, POSITION_FORMAT and VELOCITY_FORMAT are injected by the
+// host, QUANTIZED_POSITION when positions are stored normalized to the
+// bounding box, and philox() and uniform_float() from simgll::philoxGlsl()
+
+// Every invocation takes the slot of an expired particle from the dead
+// list, spawns a particle there and appends it to the alive list updated
+// this frame
+layout (local_size_x = LOCAL_SIZE) in;
+
+layout (POSITION_FORMAT, binding = 0) uniform writeonly imageBuffer positionBuffer;
+layout (VELOCITY_FORMAT, binding = 1) uniform writeonly imageBuffer velocityBuffer;
+
+struct draw_command
+{
+    uint count;
+    uint instance_count;
+    uint first;
+    uint base_instance;
+};
+
+layout (std430, binding = 1) buffer particle_counters
+{
+    draw_command draw[2];
+    uvec3 dispatch_groups;
+    uint dead_count;
+};
+
+layout (std430, binding = 3) writeonly buffer alive_out
+{
+    uint alive_index[];
+} output_list;
+
+layout (std430, binding = 4) readonly buffer dead_list
+{
+    uint dead_index[];
+};
+
+// Particles requested this frame, fewer are emitted when the dead list
+// runs out
+uniform uint emit_count = 0;
+uniform uint current = 0;
+
+// A particle spawned on frame f uses counters 2 * f and 2 * f + 1 of the
+// stream of its slot, the initial ones frame 0
+uniform uint seed = 0;
+uniform uint frame = 1;
+
+uniform vec3 bounds_min = vec3(-128.0);
+uniform vec3 bounds_max = vec3(128.0);
+
+void store_position(int i, vec4 pos)
+{
+#ifdef QUANTIZED_POSITION
+    pos.xyz = (pos.xyz - bounds_min) / (bounds_max - bounds_min);
+#endif
+    imageStore(positionBuffer, i, pos);
+}
+
+void main()
+{
+    if(gl_GlobalInvocationID.x >= emit_count)
+    {
+        return;
+    }
+
+    // Pop a slot, a pop from an empty list is undone
+    uint dead = atomicAdd(dead_count, 0xFFFFFFFFu);
+
+    if(dead == 0u || dead > uint(imageSize(positionBuffer)))
+    {
+        atomicAdd(dead_count, 1u);
+
+        return;
+    }
+
+    int index = int(dead_index[dead - 1u]);
+
+    // Same distribution as the initial particles, with a full life
+    vec4 a = uniform_float(philox(seed, uint(index), 2u * frame));
+    vec4 b = uniform_float(philox(seed, uint(index), 2u * frame + 1u));
+
+    vec4 pos = vec4(a.xyz - 0.5, 1.0);
+    vec4 vel = vec4((b.xyz - 0.5) / 5.0, 0.0);
+
+    store_position(index, pos);
+    imageStore(velocityBuffer, index, vel);
+
+    output_list.alive_index[atomicAdd(draw[current].count, 1u)] = uint(index);
+}
@@ -1,14 +1,28 @@
 #include <iostream>
 #include <cstdlib>
 #include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <array>
 #include <random>
+#include <string>
+#include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include "context.h"
+#include "buffer.h"
+#include "cpu.h"
+#include "random.h"
+#include "readback.h"
 #include "shaderprogram.h"
+#include "threadpool.h"
 #include "camera.h"
 
 constexpr GLuint WIDTH                = 512;
@@ -16,133 +30,293 @@ constexpr GLuint HEIGHT               = 512;
 constexpr GLuint PARTICLE_GROUP_SIZE  = 512;
 constexpr GLuint PARTICLE_GROUP_COUNT = 4096;
 constexpr GLint  PARTICLE_COUNT       = PARTICLE_GROUP_SIZE * PARTICLE_GROUP_COUNT;
-constexpr GLuint MAX_ATTRACTORS       = 64;
 
-void error_callback(GLint error, const GLchar* description);
+// Particles generated by each task of the initialization
+constexpr GLuint INIT_GRAIN           = 1 << 16;
+
+// Defaults, they can be overridden from the command line:
+// ParticleSystem [storage] [attractors] [particles emitted per frame]
+// The number of attractors is only limited by the size of the storage
+// buffer. Particles live 10000 frames, so the default rate roughly keeps
+// every slot in use.
+constexpr GLuint NUM_ATTRACTORS       = 32;
+constexpr GLuint EMIT_RATE            = 256;
 
-int main()
+// Relative tolerance of the check of the first frame against the CPU
+// backend, both sides only differ by floating point contraction
+constexpr GLfloat CHECK_TOLERANCE     = 1e-5f;
+
+// Mirrors the particle_counters block of the compute shaders, the alive
+// list lengths are the counts of the indirect draws
+struct DrawArraysIndirectCommand
 {
-    glfwSetErrorCallback(error_callback);
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+struct ParticleCounters
+{
+    DrawArraysIndirectCommand draw[2];
+    GLuint dispatchGroups[3];
+    GLuint deadCount;
+};
+
+// Box covered by quantized positions, it must match the defaults of
+// bounds_min and bounds_max in the shaders
+constexpr GLfloat BOUNDS = 128.0f;
+
+// How the particle state is stored, selected from the command line:
+// ParticleSystem [float|half|quantized]
+struct Storage
+{
+    const char* name;
+    GLenum      positionFormat;
+    GLenum      velocityFormat;
+};
+
+// float:     32 bytes per particle
+// half:      fp16 velocities, 24 bytes per particle
+// quantized: 16-bit normalized positions in the bounding box and fp16
+//            velocities, 16 bytes per particle
+// The smaller modes are lossy, they trade precision for memory traffic
+const Storage STORAGE_MODES[] =
+{
+    { "float",     GL_RGBA32F, GL_RGBA32F },
+    { "half",      GL_RGBA32F, GL_RGBA16F },
+    { "quantized", GL_RGBA16,  GL_RGBA16F }
+};
 
-    glfwInit();
+GLsizeiptr texelSize(GLenum format);
+const GLchar* glslFormat(GLenum format);
+void encodeTexel(const glm::vec4& value, GLenum format, GLubyte* texel);
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+void error_callback(GLint error, const GLchar* description);
 
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "OpenGL App",
-                                          nullptr, nullptr);
+int main(int argc, char* argv[])
+{
+    std::string mode = argc > 1 ? argv[1] : "float";
+    const Storage* storage = nullptr;
 
-    if(!window)
+    for(const Storage& candidate : STORAGE_MODES)
     {
-        glfwTerminate();
-        exit(1);
+        if(mode == candidate.name)
+        {
+            storage = &candidate;
+        }
     }
 
-    glfwMakeContextCurrent(window);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    glewExperimental = GL_TRUE;
-    GLenum status = glewInit();
-
-    if(status != GLEW_OK)
+    if(!storage)
     {
-        std::cerr << "GLEW Error: " << glewGetErrorString(status) << "\n";
+        std::cerr << "Unknown storage " << mode
+                  << ", available: float half quantized\n";
 
         exit(1);
     }
 
-    // Generate two buffers, bind them and initialize their data stores
-    GLuint buffers[3], vao;
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(3, buffers);
+    GLboolean quantized = storage->positionFormat == GL_RGBA16;
 
-    glBindVertexArray(vao);
+    GLuint attractorCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : NUM_ATTRACTORS;
+    GLuint emitRate       = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : EMIT_RATE;
 
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, 4 * PARTICLE_COUNT * sizeof(GLfloat),
-                 nullptr, GL_DYNAMIC_COPY);
+    glfwSetErrorCallback(error_callback);
 
-    GLfloat* positions = static_cast<GLfloat*>(glMapBufferRange(GL_ARRAY_BUFFER,
-                                                                0,
-                                                                4 * PARTICLE_COUNT * sizeof(GLfloat),
-                                                                GL_MAP_WRITE_BIT |
-                                                                GL_MAP_INVALIDATE_BUFFER_BIT));
+    simgll::Context context(simgll::Context::Type::Window, WIDTH, HEIGHT,
+                            "OpenGL App", 4, 3);
+    GLFWwindow* window = context.window();
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     std::random_device rd;
-    std::mt19937 engine(rd());
-    std::uniform_real_distribution<> dist(0.0, 1.0);
+    GLuint seed = rd();
+
+    // Position and velocity buffers, both are only written by the host at
+    // initialization, already encoded in their storage format
+    GLsizeiptr positionSize  = texelSize(storage->positionFormat);
+    GLsizeiptr velocitySize  = texelSize(storage->velocityFormat);
+    GLsizeiptr positionBytes = PARTICLE_COUNT * positionSize;
+    GLsizeiptr velocityBytes = PARTICLE_COUNT * velocitySize;
+
+    simgll::Buffer<GLubyte> positionBuffer(positionBytes);
+    simgll::Buffer<GLubyte> velocityBuffer(velocityBytes);
+
+    // The first frame is checked against the CPU backend, only with the
+    // float storage since the other modes round every store
+    GLboolean checked = storage->positionFormat == GL_RGBA32F &&
+                        storage->velocityFormat == GL_RGBA32F;
+
+    std::vector<GLfloat> referencePositions(checked ? 4 * PARTICLE_COUNT : 0);
+    std::vector<GLfloat> referenceVelocities(checked ? 4 * PARTICLE_COUNT : 0);
 
-    for(GLint i = 0; i < PARTICLE_COUNT; i++)
     {
-        *positions++ = (dist(engine) - 0.5f) * 1.0f;
-        *positions++ = (dist(engine) - 0.5f) * 1.0f;
-        *positions++ = (dist(engine) - 0.5f) * 1.0f;
-        *positions++ = dist(engine);
+        // The particles are generated in parallel straight into a mapped
+        // staging buffer, then copied by the GPU so that the buffers used
+        // every frame stay in video memory
+        simgll::Buffer<GLubyte> staging(positionBytes + velocityBytes,
+                                        GL_MAP_WRITE_BIT |
+                                        GL_MAP_PERSISTENT_BIT |
+                                        GL_MAP_COHERENT_BIT);
+
+        GLubyte* positions  = staging.data();
+        GLubyte* velocities = staging.data() + positionBytes;
+
+        simgll::ThreadPool::global().parallelFor(0, PARTICLE_COUNT, INIT_GRAIN,
+            [&](std::size_t first, std::size_t last)
+        {
+            for(std::size_t i = first; i < last; i++)
+            {
+                // Frame 0 of the stream of the slot, the same numbers
+                // emit.glsl would draw there
+                GLuint stream = static_cast<GLuint>(i);
+                std::array<GLuint, 4> a = simgll::philox(seed, stream, 0);
+                std::array<GLuint, 4> b = simgll::philox(seed, stream, 1);
+
+                glm::vec4 position;
+                position.x = simgll::uniformFloat(a[0]) - 0.5f;
+                position.y = simgll::uniformFloat(a[1]) - 0.5f;
+                position.z = simgll::uniformFloat(a[2]) - 0.5f;
+                position.w = simgll::uniformFloat(a[3]);
+
+                // Quantized positions are stored relative to the bounding box
+                if(quantized)
+                {
+                    position.x = (position.x + BOUNDS) / (2.0f * BOUNDS);
+                    position.y = (position.y + BOUNDS) / (2.0f * BOUNDS);
+                    position.z = (position.z + BOUNDS) / (2.0f * BOUNDS);
+                }
+
+                // Velocities are also random vectors
+                glm::vec4 velocity;
+                velocity.x = (simgll::uniformFloat(b[0]) - 0.5f) / 5.0f;
+                velocity.y = (simgll::uniformFloat(b[1]) - 0.5f) / 5.0f;
+                velocity.z = (simgll::uniformFloat(b[2]) - 0.5f) / 5.0f;
+                velocity.w = 0.0f;
+
+                encodeTexel(position, storage->positionFormat,
+                            positions + i * positionSize);
+                encodeTexel(velocity, storage->velocityFormat,
+                            velocities + i * velocitySize);
+
+                // The staging buffer is write only, the reference keeps its
+                // own copy
+                if(checked)
+                {
+                    std::memcpy(&referencePositions[4 * i], &position,
+                                4 * sizeof(GLfloat));
+                    std::memcpy(&referenceVelocities[4 * i], &velocity,
+                                4 * sizeof(GLfloat));
+                }
+            }
+        });
+
+        // The mapping is coherent, the copies see every write of the loop
+        glBindBuffer(GL_COPY_READ_BUFFER, staging.name());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, positionBuffer.name());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                            positionBytes);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, velocityBuffer.name());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            positionBytes, 0, velocityBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
     }
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    // Every particle starts alive, in list 0. Expired particles move to the
+    // dead list and emission takes them back from it, so the update and the
+    // draw only process the particles that are alive.
+    std::vector<GLuint> indices(PARTICLE_COUNT);
 
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-    glEnableVertexAttribArray(0);
+    for(GLint i = 0; i < PARTICLE_COUNT; i++)
+    {
+        indices[i] = i;
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    simgll::Buffer<GLuint> aliveBuffers[2] =
+    {
+        simgll::Buffer<GLuint>(PARTICLE_COUNT, 0, indices.data()),
+        simgll::Buffer<GLuint>(PARTICLE_COUNT)
+    };
+
+    simgll::Buffer<GLuint> deadBuffer(PARTICLE_COUNT);
 
-    // Initialization of the velocity buffer - also filled with random vectors
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, 4 * PARTICLE_COUNT * sizeof(GLfloat),
-                 nullptr, GL_DYNAMIC_COPY);
+    ParticleCounters counters = { { { PARTICLE_COUNT, 1, 0, 0 },
+                                    { 0, 1, 0, 0 } },
+                                  { 0, 1, 1 }, 0 };
+    simgll::Buffer<ParticleCounters> counterBuffer(1, 0, &counters);
 
-    GLfloat* velocities = static_cast<GLfloat*>(glMapBufferRange(GL_ARRAY_BUFFER,
-                                                                 0,
-                                                                 4 * PARTICLE_COUNT * sizeof(GLfloat),
-                                                                 GL_MAP_WRITE_BIT |
-                                                                 GL_MAP_INVALIDATE_BUFFER_BIT));
+    // The vertices of a draw are the entries of an alive list
+    GLuint vaos[2];
+    glGenVertexArrays(2, vaos);
 
-    for(GLuint i = 0; i < PARTICLE_COUNT; i++)
+    for(int i = 0; i < 2; i++)
     {
-        velocities[4 * i]     = (static_cast<GLfloat>(rand()) / RAND_MAX - 0.5f) / 5.0f;
-        velocities[4 * i + 1] = (static_cast<GLfloat>(rand()) / RAND_MAX - 0.5f) / 5.0f;
-        velocities[4 * i + 2] = (static_cast<GLfloat>(rand()) / RAND_MAX - 0.5f) / 5.0f;
-        velocities[4 * i + 3] = 0.0f;
+        glBindVertexArray(vaos[i]);
+
+        glBindBuffer(GL_ARRAY_BUFFER, aliveBuffers[i].name());
+        glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, 0, (GLvoid*)0);
+        glEnableVertexAttribArray(0);
     }
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     GLuint tbos[2];
     glGenTextures(2, tbos);
 
-    for(GLuint i = 0; i < 2; i++)
-    {
-        glBindTexture(GL_TEXTURE_BUFFER, tbos[i]);
-        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffers[i]);
-    }
+    glBindTexture(GL_TEXTURE_BUFFER, tbos[0]);
+    glTexBuffer(GL_TEXTURE_BUFFER, storage->positionFormat, positionBuffer.name());
+    glBindTexture(GL_TEXTURE_BUFFER, tbos[1]);
+    glTexBuffer(GL_TEXTURE_BUFFER, storage->velocityFormat, velocityBuffer.name());
 
-    glBindBuffer(GL_UNIFORM_BUFFER, buffers[2]);
-    glBufferData(GL_UNIFORM_BUFFER, 32 * 4 * sizeof(GLfloat), nullptr, GL_STATIC_DRAW);
+    // Attractor ssbo, streamed every frame through a persistently mapped
+    // ring so the host never maps or waits on the driver
+    simgll::RingBuffer attractorBuffer(std::max(attractorCount, 1U) * sizeof(glm::vec4));
 
-    // Attractor ubo
-    float attractorMasses[MAX_ATTRACTORS];
+    std::vector<GLfloat> attractorMasses(attractorCount);
 
-    for(GLuint i = 0; i < MAX_ATTRACTORS; i++)
+    // The attractors use the streams after the particle slots
+    for(GLuint i = 0; i < attractorCount; i++)
     {
-        attractorMasses[i] = 0.5f + (static_cast<GLfloat>(rand()) / RAND_MAX) * 0.5f;
+        GLuint bits = simgll::philox(seed, PARTICLE_COUNT + i, 0)[0];
+        attractorMasses[i] = 0.5f + simgll::uniformFloat(bits) * 0.5f;
     }
 
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, buffers[2]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
+    std::string header = "#define LOCAL_SIZE " + std::to_string(PARTICLE_GROUP_SIZE) + "\n" +
+                         "#define POSITION_FORMAT " +
+                         glslFormat(storage->positionFormat) + "\n" +
+                         "#define VELOCITY_FORMAT " +
+                         glslFormat(storage->velocityFormat) + "\n" +
+                         (quantized ? "#define QUANTIZED_POSITION\n" : "");
+
+    simgll::ShaderProgram emitProgram;
+    emitProgram.addShader("emit.glsl", GL_COMPUTE_SHADER,
+                          header + simgll::philoxGlsl());
+    emitProgram.compile();
+
+    GLint frameLocation       = emitProgram.getLocation("frame");
+    GLint emitCurrentLocation = emitProgram.getLocation("current");
+
+    emitProgram.set("emit_count", emitRate);
+    emitProgram.set("seed", seed);
+
+    simgll::ShaderProgram dispatchArgsProgram;
+    dispatchArgsProgram.addShader("dispatch_args.glsl", GL_COMPUTE_SHADER, header);
+    dispatchArgsProgram.compile();
+
+    GLint argsCurrentLocation = dispatchArgsProgram.getLocation("current");
+
     simgll::ShaderProgram computeProgram;
-    computeProgram.addShader("compute_shader.glsl", GL_COMPUTE_SHADER);
+    computeProgram.addShader("compute_shader.glsl", GL_COMPUTE_SHADER, header);
     computeProgram.compile();
 
-    GLint dtLocation = computeProgram.getLocation("dt");
+    GLint dtLocation      = computeProgram.getLocation("dt");
+    GLint currentLocation = computeProgram.getLocation("current");
+
+    computeProgram.set("attractor_count", attractorCount);
 
     simgll::ShaderProgram renderProgram;
-    renderProgram.addShader("vertex_shader.glsl",   GL_VERTEX_SHADER);
+    renderProgram.addShader("vertex_shader.glsl",   GL_VERTEX_SHADER, header);
     renderProgram.addShader("fragment_shader.glsl", GL_FRAGMENT_SHADER);
     renderProgram.compile();
 
@@ -161,22 +335,25 @@ int main()
     GLfloat deltaTime   = 0.0f;
     GLfloat oldTime     = 0.0f;
 
-    while(!glfwWindowShouldClose(window))
-    {
-        currentTime = static_cast<float>(glfwGetTime());
-        deltaTime   = currentTime - oldTime;
-        oldTime     = currentTime;
+    // The update is timed on the GPU, the results of a query are read a
+    // frame later so the host never waits for them
+    GLuint timerQueries[2];
+    glGenQueries(2, timerQueries);
 
-        glfwPollEvents();
+    GLuint frameIndex = 0;
+    GLuint issuedQueries = 0;
+    GLuint64 updateTime = 0;
+    GLuint timedFrames = 0;
+    GLfloat reportTime = 0.0f;
 
-        // Update the buffer containing the attractor positions and masses
-        GLfloat* attractors = static_cast<GLfloat*>(glMapBufferRange(GL_UNIFORM_BUFFER,
-                                                                     0,
-                                                                     32 * 4 * sizeof(GLfloat),
-                                                                     GL_MAP_WRITE_BIT |
-                                                                     GL_MAP_INVALIDATE_BUFFER_BIT));
+    // Number of particles alive, read back once a second for the report
+    GLuint aliveCount = PARTICLE_COUNT;
+    simgll::ReadbackQueue readback(sizeof(GLuint));
 
-        for(GLuint i = 0; i < 32; i++)
+    // Attractors orbit with the frame time, xyz = position and w = mass
+    auto updateAttractors = [&](GLfloat* attractors)
+    {
+        for(GLuint i = 0; i < attractorCount; i++)
         {
             attractors[4 * i]     = sinf(deltaTime * static_cast<GLfloat>(i + 4) * 7.5f * 20.0f) * 50.0f;
             attractors[4 * i + 1] = cosf(deltaTime * static_cast<GLfloat>(i + 7) * 3.9f * 20.0f) * 50.0f;
@@ -184,22 +361,139 @@ int main()
                                     cosf(deltaTime * static_cast<GLfloat>(i + 5) * 9.1f) * 100.0f;
             attractors[4 * i + 3] = attractorMasses[i];
         }
+    };
+
+    // Both buffers of the first frame are read back whole. The update
+    // doesn't store the particles that expire on it, they keep their initial
+    // state on the GPU and the reference takes it from the readback.
+    simgll::ReadbackQueue check(checked ? positionBytes : sizeof(GLfloat), 2);
+    std::vector<GLint> expired;
+    std::size_t mismatches = 0;
+
+    auto compare = [&](const GLvoid* data, std::vector<GLfloat>& reference)
+    {
+        const GLfloat* ptr = static_cast<const GLfloat*>(data);
+
+        for(GLint i : expired)
+        {
+            std::copy_n(ptr + 4 * i, 4, &reference[4 * i]);
+        }
+
+        return simgll::cpu::countMismatches(ptr, 4, reference.data(), 4,
+                                            PARTICLE_COUNT, 4, CHECK_TOLERANCE);
+    };
+
+    auto checkPositions = [&](const GLvoid* data, GLsizeiptr)
+    {
+        mismatches += compare(data, referencePositions);
+    };
+
+    auto checkVelocities = [&](const GLvoid* data, GLsizeiptr)
+    {
+        mismatches += compare(data, referenceVelocities);
+
+        std::cout << "First frame: " << mismatches
+                  << " mismatches against the CPU backend\n";
+    };
+
+    // Alive list updated this frame, the survivors go to the other one
+    GLuint current = 0;
 
-        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    // Frame 0 drew the initial particles
+    GLuint frame = 1;
 
-        // Activate the compute program and bind the position and velocity
-        // buffers
+    while(!context.shouldClose())
+    {
+        currentTime = static_cast<float>(glfwGetTime());
+        deltaTime   = currentTime - oldTime;
+        oldTime     = currentTime;
+
+        context.pollEvents();
+
+        // Update the buffer containing the attractor positions and masses
+        updateAttractors(attractorBuffer.begin<GLfloat>());
+
+        // Every particle is alive and none is emitted on the first frame,
+        // the reference is a single step over all of them
+        GLboolean checkFrame = checked && frame == 1;
+
+        if(checkFrame)
+        {
+            std::vector<GLfloat> attractors(4 * attractorCount);
+            updateAttractors(attractors.data());
+
+            simgll::cpu::particleUpdate(referencePositions.data(),
+                                        referenceVelocities.data(),
+                                        PARTICLE_COUNT, attractors.data(),
+                                        attractorCount, 1.0f);
+
+            for(GLint i = 0; i < PARTICLE_COUNT; i++)
+            {
+                if(referencePositions[4 * i + 3] <= 0.0f)
+                {
+                    expired.push_back(i);
+                }
+            }
+        }
+
+        attractorBuffer.bindRange(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glBindImageTexture(0, tbos[0], 0, GL_FALSE, 0, GL_READ_WRITE, storage->positionFormat);
+        glBindImageTexture(1, tbos[1], 0, GL_FALSE, 0, GL_READ_WRITE, storage->velocityFormat);
+
+        counterBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+        aliveBuffers[current].bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+        deadBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+
+        // Respawn expired particles into the list updated this frame
+        emitProgram.use();
+        emitProgram.set(emitCurrentLocation, current);
+        emitProgram.set(frameLocation, frame++);
+
+        aliveBuffers[current].bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+
+        glDispatchCompute((emitRate + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        dispatchArgsProgram.use();
+        dispatchArgsProgram.set(argsCurrentLocation, current);
+
+        glDispatchCompute(1, 1, 1);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        // Activate the compute program, it processes only the alive list
         computeProgram.use();
+        computeProgram.set(currentLocation, current);
+        computeProgram.set(dtLocation, 1.0f);
 
-        glBindImageTexture(0, tbos[0], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-        glBindImageTexture(1, tbos[1], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        aliveBuffers[current ^ 1].bindBase(GL_SHADER_STORAGE_BUFFER, 3);
 
-        glUniform1f(dtLocation, 1.0f);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counterBuffer.name());
 
-        glDispatchCompute(PARTICLE_GROUP_COUNT, 1, 1);
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries[frameIndex]);
+        glDispatchComputeIndirect(offsetof(ParticleCounters, dispatchGroups));
+        glEndQuery(GL_TIME_ELAPSED);
 
-        // Ensure that writes by the compute shader have completed
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        // The attractor region can be reused once the dispatch has completed
+        attractorBuffer.end();
+
+        if(checkFrame)
+        {
+            check.enqueue(positionBuffer.name(), 0, positionBytes,
+                          checkPositions);
+            check.enqueue(velocityBuffer.name(), 0, velocityBytes,
+                          checkVelocities);
+        }
+
+        current ^= 1;
+
+        // The next passes read the particles and the new alive list and the
+        // draw takes its count from the counters
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                        GL_TEXTURE_FETCH_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                        GL_COMMAND_BARRIER_BIT);
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glDisable(GL_DEPTH_TEST);
@@ -207,22 +501,116 @@ int main()
         renderProgram.use();
 
         auto mvp = camera.update(deltaTime, 45.0F, 0.1F, 1000.0F);
-        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &mvp[0][0]);
+        renderProgram.set(mvpLocation, mvp);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, tbos[0]);
 
-        glBindVertexArray(vao);
+        glBindVertexArray(vaos[current]);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, counterBuffer.name());
 
         glEnable(GL_BLEND);
         glBlendFunc(GL_ONE, GL_ONE);
-        glDrawArrays(GL_POINTS, 0, PARTICLE_COUNT);
+        glDrawArraysIndirect(GL_POINTS, reinterpret_cast<GLvoid*>(
+            offsetof(ParticleCounters, draw) + current * sizeof(DrawArraysIndirectCommand)));
+
+        context.swapBuffers();
+
+        frameIndex ^= 1;
+
+        // The other query only exists once it has been issued
+        issuedQueries = std::min(issuedQueries + 1, 2U);
 
-        glfwSwapBuffers(window);
+        GLuint available = GL_FALSE;
+
+        if(issuedQueries == 2)
+        {
+            glGetQueryObjectuiv(timerQueries[frameIndex], GL_QUERY_RESULT_AVAILABLE,
+                                &available);
+        }
+
+        if(available)
+        {
+            GLuint64 elapsed;
+            glGetQueryObjectui64v(timerQueries[frameIndex], GL_QUERY_RESULT, &elapsed);
+
+            updateTime += elapsed;
+            timedFrames++;
+        }
+
+        readback.poll();
+        check.poll();
+
+        // Report the throughput of the update once a second
+        if(currentTime - reportTime >= 1.0f && timedFrames > 0)
+        {
+            GLdouble seconds = updateTime * 1.0e-9 / timedFrames;
+
+            std::cout << "Update = " << seconds * 1.0e3 << " ms, "
+                      << aliveCount << " particles alive, "
+                      << aliveCount * static_cast<GLdouble>(attractorCount) / seconds
+                      << " particle-attractor interactions/s\n";
+
+            readback.enqueue(counterBuffer.name(),
+                             offsetof(ParticleCounters, draw) +
+                             current * sizeof(DrawArraysIndirectCommand),
+                             sizeof(GLuint),
+                             [&](const GLvoid* data, GLsizeiptr)
+            {
+                aliveCount = *static_cast<const GLuint*>(data);
+            });
+
+            updateTime  = 0;
+            timedFrames = 0;
+            reportTime  = currentTime;
+        }
     }
 
-    glfwTerminate();
+    glDeleteQueries(2, timerQueries);
 
     return 0;
 }
 
+GLsizeiptr texelSize(GLenum format)
+{
+    return format == GL_RGBA32F ? 4 * sizeof(GLfloat) : 4 * sizeof(GLushort);
+}
+
+const GLchar* glslFormat(GLenum format)
+{
+    switch(format)
+    {
+    case GL_RGBA16F:
+        return "rgba16f";
+    case GL_RGBA16:
+        return "rgba16";
+    default:
+        return "rgba32f";
+    }
+}
+
+// Writes a value as a texel of an RGBA32F, RGBA16F or RGBA16 buffer texture,
+// RGBA16 values must already be in [0, 1]
+void encodeTexel(const glm::vec4& value, GLenum format, GLubyte* texel)
+{
+    if(format == GL_RGBA32F)
+    {
+        std::memcpy(texel, &value, 4 * sizeof(GLfloat));
+
+        return;
+    }
+
+    GLushort packed[4];
+
+    for(GLint c = 0; c < 4; c++)
+    {
+        packed[c] = format == GL_RGBA16F ? glm::packHalf1x16(value[c]) :
+                                           glm::packUnorm1x16(value[c]);
+    }
+
+    std::memcpy(texel, packed, sizeof(packed));
+}
+
 void error_callback(GLint error, const GLchar* description)
 {
     std::cerr << "GLFW Error " << error << ": " << description << "\n";
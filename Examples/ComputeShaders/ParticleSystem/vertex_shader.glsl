@@ -1,13 +1,29 @@
 #version 430 core
 
-layout (location = 0) in vec4 position;
+// QUANTIZED_POSITION is injected by the host when positions are stored
+// normalized to the bounding box
+
+// Every vertex is an entry of the alive list, the particle is fetched from
+// the position buffer, which converts it from its storage format
+layout (location = 0) in uint index;
+
+layout (binding = 0) uniform samplerBuffer positionBuffer;
 
 out float intensity;
 
 uniform mat4 mvp;
 
+uniform vec3 bounds_min = vec3(-128.0);
+uniform vec3 bounds_max = vec3(128.0);
+
 void main()
 {
+    vec4 position = texelFetch(positionBuffer, int(index));
+
     intensity = position.w;
+#ifdef QUANTIZED_POSITION
+    gl_Position = mvp * vec4(mix(bounds_min, bounds_max, position.xyz), 1.0);
+#else
     gl_Position = mvp * vec4(position.xyz, 1.0);
+#endif
 }
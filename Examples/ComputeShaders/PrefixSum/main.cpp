@@ -1,137 +1,90 @@
+#include <chrono>
 #include <iostream>
 #include <cstdlib>
 #include <vector>
 #include <GL/glew.h>
-#include <GLFW/glfw3.h>
 
-#include "shaderprogram.h"
+#include "buffer.h"
+#include "compute.h"
+#include "context.h"
+#include "cpu.h"
+#include "readback.h"
+#include "threadpool.h"
 
 constexpr GLuint WIDTH = 512, HEIGHT = 512;
-constexpr GLuint NUM_ELEMENTS = 2048;
-
-void error_callback(GLint error, const GLchar* description);
-void prefix_sum(const float* input, float* output, int elements);
+constexpr GLuint NUM_ELEMENTS = 1 << 20;
+constexpr GLuint NUM_ITER     = 16;
 
 int main()
 {
-    glfwSetErrorCallback(error_callback);
-
-    glfwInit();
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "OpenGL App",
-                                          nullptr, nullptr);
-
-    if(!window)
-    {
-        glfwTerminate();
-
-        exit(1);
-    }
+    simgll::Context context(simgll::Context::Type::Headless, WIDTH, HEIGHT);
 
-    glfwMakeContextCurrent(window);
+    // Multi-level scan, the input doesn't have to fit in a single workgroup
+    simgll::compute::Scan scan(simgll::compute::Type::Float);
 
-    glewExperimental = GL_TRUE;
-    GLenum status = glewInit();
-
-    if(status != GLEW_OK)
-    {
-        std::cerr << "GLEW Error: " << glewGetErrorString(status) << "\n";
-
-        exit(1);
-    }
-
-    simgll::ShaderProgram computeProgram;
-    computeProgram.addShader("compute_shader.glsl", GL_COMPUTE_SHADER);
-    computeProgram.compile();
-
-    GLuint dataBuffers[2];
-
-    glGenBuffers(2, dataBuffers);
-
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dataBuffers[0]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, NUM_ELEMENTS * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dataBuffers[1]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, NUM_ELEMENTS * sizeof(float), nullptr, GL_DYNAMIC_COPY);
+    simgll::Buffer<GLfloat> inputBuffer(NUM_ELEMENTS, GL_DYNAMIC_STORAGE_BIT);
+    simgll::Buffer<GLfloat> outputBuffer(NUM_ELEMENTS);
 
     std::vector<GLfloat> inputData(NUM_ELEMENTS);
     std::vector<GLfloat> outputData(NUM_ELEMENTS);
 
+    // Small integers keep every partial sum exact in single precision
     for(GLuint i = 0; i < NUM_ELEMENTS; i++)
     {
-        inputData[i] = static_cast<float>(i);
+        inputData[i] = static_cast<float>(i % 16);
     }
 
-    prefix_sum(inputData.data(), outputData.data(), NUM_ELEMENTS);
+    // Reference computed by the multi-threaded CPU backend
+    auto start = std::chrono::steady_clock::now();
+    simgll::cpu::scan(inputData.data(), outputData.data(), NUM_ELEMENTS);
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
 
-    glShaderStorageBlockBinding(computeProgram.name(), 0, 0);
-    glShaderStorageBlockBinding(computeProgram.name(), 1, 1);
-
-    while(!glfwWindowShouldClose(window))
+    for(GLuint i = 0; i < 15; i++)
     {
-        float* ptr;
-
-        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, dataBuffers[0], 0,
-                          NUM_ELEMENTS * sizeof(GLfloat));
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, NUM_ELEMENTS *
-                        sizeof(GLfloat), inputData.data());
+        std::cout << outputData[i] << ", ";
+    }
 
-        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, dataBuffers[1], 0,
-                          NUM_ELEMENTS * sizeof(GLfloat));
+    std::cout << "... CPU scan took " << elapsed.count() << " ms on "
+              << simgll::ThreadPool::global().size() << " threads\n";
 
-        computeProgram.use();
-        glDispatchCompute(1, 1, 1);
+    // Results are delivered a few iterations after their dispatch, so the
+    // host never waits for the GPU to drain
+    simgll::ReadbackQueue readback(NUM_ELEMENTS * sizeof(GLfloat));
 
-        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-        glFinish();
+    auto printResult = [&outputData](const GLvoid* data, GLsizeiptr)
+    {
+        const GLfloat* ptr = static_cast<const GLfloat*>(data);
+        GLuint errors = 0;
 
-        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, dataBuffers[1], 0,
-                          NUM_ELEMENTS * sizeof(GLfloat));
-        ptr = (GLfloat*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0,
-                                         NUM_ELEMENTS * sizeof(GLfloat),
-                                         GL_MAP_READ_BIT);
+        for(GLuint i = 0; i < NUM_ELEMENTS; i++)
+        {
+            if(ptr[i] != outputData[i])
+            {
+                errors++;
+            }
+        }
 
         for(GLuint i = 0; i < 15; i++)
         {
-            std::cout << *ptr++ << ", ";
+            std::cout << ptr[i] << ", ";
         }
 
-        std::cout << "\n";
-
-        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-    }
-
-    glDeleteBuffers(2, dataBuffers);
-
-    glfwTerminate();
+        std::cout << "... " << errors << " errors\n";
+    };
 
-    return 0;
-}
-
-void error_callback(GLint error, const GLchar* description)
-{
-    std::cerr << "GLFW Error " << error << ": " << description << "\n";
-}
+    for(GLuint iter = 0; iter < NUM_ITER; iter++)
+    {
+        inputBuffer.upload(inputData.data(), NUM_ELEMENTS);
 
-void prefix_sum(const float* input, float* output, int size)
-{
-    float f = 0.0f;
+        scan.run(inputBuffer.name(), outputBuffer.name(), NUM_ELEMENTS);
 
-    for (GLint i = 0; i < size; i++)
-    {
-        f += input[i];
-        output[i] = f;
+        readback.enqueue(outputBuffer.name(), 0, NUM_ELEMENTS * sizeof(GLfloat),
+                         printResult);
+        readback.poll();
     }
 
-    for (GLint i = 0; i < 15; i++)
-    {
-        std::cout << output[i] << ", ";
-    }
+    readback.flush();
 
-    std::cin.get();
+    return 0;
 }
@@ -0,0 +1,41 @@
+#version 430 core
+
+// FLOCK_SIZE is injected by the host
+
+layout (local_size_x = 256) in;
+
+uniform uint num_partials;
+
+layout (std430, binding = 3) readonly buffer partial_centers
+{
+    vec4 partial_center[];
+};
+
+layout (std430, binding = 4) writeonly buffer flock_center
+{
+    vec4 center;
+};
+
+shared vec3 shared_sum[gl_WorkGroupSize.x];
+
+void main(void)
+{
+    uint local_id = gl_LocalInvocationID.x;
+    vec3 sum = vec3(0.0);
+
+    for (uint i = local_id; i < num_partials; i += gl_WorkGroupSize.x)
+        sum += partial_center[i].xyz;
+
+    shared_sum[local_id] = sum;
+    barrier();
+
+    for (uint stride = gl_WorkGroupSize.x / 2; stride > 0; stride >>= 1)
+    {
+        if (local_id < stride)
+            shared_sum[local_id] += shared_sum[local_id + stride];
+        barrier();
+    }
+
+    if (local_id == 0)
+        center = vec4(shared_sum[0] / float(FLOCK_SIZE), 1.0);
+}
@@ -1,6 +1,10 @@
 #version 430 core
 
-layout (local_size_x = 256) in;
+// FLOCK_SIZE, LOCAL_SIZE and TABLE_SIZE are injected by the host, and
+// SOA_LAYOUT when the flock is stored as separate position and velocity
+// streams instead of flock_member records
+
+layout (local_size_x = LOCAL_SIZE) in;
 
 uniform float closest_allowed_dist = 50.0;
 uniform float rule1_weight = 0.18;
@@ -10,23 +14,115 @@ uniform float rule4_weight = 0.02;
 uniform vec3 goal = vec3(0.0);
 uniform float timestep = 0.4;
 
+// Cells are cubes of side sqrt(closest_allowed_dist), the neighbors that
+// the rules consider are the members of the 27 cells around a member that
+// are closer than that
+uniform float cell_size;
+
 struct flock_member
 {
     vec3 position;
     vec3 velocity;
 };
 
+struct sorted_member
+{
+    vec3 position;
+    uint index;
+    vec3 velocity;
+};
+
+#ifdef SOA_LAYOUT
+layout (std430, binding = 0) readonly buffer positions_in
+{
+    float position[];
+} input_position;
+
+layout (std430, binding = 6) readonly buffer velocities_in
+{
+    float velocity[];
+} input_velocity;
+
+layout (std430, binding = 1) writeonly buffer positions_out
+{
+    float position[];
+} output_position;
+
+layout (std430, binding = 7) writeonly buffer velocities_out
+{
+    float velocity[];
+} output_velocity;
+
+flock_member load_member(uint i)
+{
+    flock_member m;
+    m.position = vec3(input_position.position[3 * i],
+                      input_position.position[3 * i + 1],
+                      input_position.position[3 * i + 2]);
+    m.velocity = vec3(input_velocity.velocity[3 * i],
+                      input_velocity.velocity[3 * i + 1],
+                      input_velocity.velocity[3 * i + 2]);
+    return m;
+}
+
+void store_member(uint i, flock_member m)
+{
+    output_position.position[3 * i]     = m.position.x;
+    output_position.position[3 * i + 1] = m.position.y;
+    output_position.position[3 * i + 2] = m.position.z;
+    output_velocity.velocity[3 * i]     = m.velocity.x;
+    output_velocity.velocity[3 * i + 1] = m.velocity.y;
+    output_velocity.velocity[3 * i + 2] = m.velocity.z;
+}
+#else
 layout (std430, binding = 0) readonly buffer members_in
 {
     flock_member member[];
 } input_data;
 
-layout (std430, binding = 1) buffer members_out
+layout (std430, binding = 1) writeonly buffer members_out
 {
     flock_member member[];
 } output_data;
 
-shared flock_member shared_member[gl_WorkGroupSize.x];
+flock_member load_member(uint i)
+{
+    return input_data.member[i];
+}
+
+void store_member(uint i, flock_member m)
+{
+    output_data.member[i] = m;
+}
+#endif
+
+// Members ordered by cell, see grid_scatter_cs.glsl
+layout (std430, binding = 2) readonly buffer members_sorted
+{
+    sorted_member member[];
+} sorted_data;
+
+layout (std430, binding = 3) readonly buffer cell_starts
+{
+    uint cell_start[];
+};
+
+layout (std430, binding = 4) readonly buffer cell_counts
+{
+    uint cell_count[];
+};
+
+layout (std430, binding = 5) readonly buffer flock_center
+{
+    vec4 center;
+};
+
+uint cell_hash(ivec3 cell)
+{
+    return (uint(cell.x) * 73856093u ^
+            uint(cell.y) * 19349663u ^
+            uint(cell.z) * 83492791u) & (TABLE_SIZE - 1u);
+}
 
 vec3 rule1(vec3 my_position, vec3 my_velocity, vec3 their_position, vec3 their_velocity)
 {
@@ -45,49 +141,63 @@ vec3 rule2(vec3 my_position, vec3 my_velocity, vec3 their_position, vec3 their_v
 
 void main(void)
 {
-    uint i, j;
-    int global_id = int(gl_GlobalInvocationID.x);
-    int local_id  = int(gl_LocalInvocationID.x);
+    uint global_id = gl_GlobalInvocationID.x;
+
+    if (global_id >= FLOCK_SIZE)
+        return;
 
-    flock_member me = input_data.member[global_id];
+    flock_member me = load_member(global_id);
     flock_member new_me;
     vec3 accelleration = vec3(0.0);
-    vec3 flock_center = vec3(0.0);
 
-    for (i = 0; i < gl_NumWorkGroups.x; i++)
+    ivec3 my_cell = ivec3(floor(me.position / cell_size));
+
+    // Different cells can share a hash, every hash is visited only once
+    uint visited[27];
+    int num_visited = 0;
+
+    for (int z = -1; z <= 1; z++)
+    for (int y = -1; y <= 1; y++)
+    for (int x = -1; x <= 1; x++)
     {
-        flock_member them =
-            input_data.member[i * gl_WorkGroupSize.x +
-                              local_id];
-        shared_member[local_id] = them;
-        memoryBarrierShared();
-        barrier();
-        for (j = 0; j < gl_WorkGroupSize.x; j++)
+        uint cell = cell_hash(my_cell + ivec3(x, y, z));
+        bool seen = false;
+
+        for (int k = 0; k < num_visited; k++)
+            seen = seen || visited[k] == cell;
+
+        if (seen)
+            continue;
+
+        visited[num_visited++] = cell;
+
+        uint end = cell_start[cell] + cell_count[cell];
+
+        for (uint j = cell_start[cell]; j < end; j++)
         {
-            them = shared_member[j];
-            flock_center += them.position;
-            if (i * gl_WorkGroupSize.x + j != global_id)
-            {
-                accelleration += rule1(me.position,
-                                       me.velocity,
-                                       them.position,
-                                       them.velocity) * rule1_weight;
-                accelleration += rule2(me.position,
-                                       me.velocity,
-                                       them.position,
-                                       them.velocity) * rule2_weight;
-            }
+            sorted_member them = sorted_data.member[j];
+            vec3 d = me.position - them.position;
+
+            if (them.index == global_id || dot(d, d) >= closest_allowed_dist)
+                continue;
+
+            accelleration += rule1(me.position,
+                                   me.velocity,
+                                   them.position,
+                                   them.velocity) * rule1_weight;
+            accelleration += rule2(me.position,
+                                   me.velocity,
+                                   them.position,
+                                   them.velocity) * rule2_weight;
         }
-        barrier();
     }
 
-    flock_center /= float(gl_NumWorkGroups.x * gl_WorkGroupSize.x);
     new_me.position = me.position + me.velocity * timestep;
     accelleration += normalize(goal - me.position) * rule3_weight;
-    accelleration += normalize(flock_center - me.position) * rule4_weight;
+    accelleration += normalize(center.xyz - me.position) * rule4_weight;
     new_me.velocity = me.velocity + accelleration * timestep;
     if (length(new_me.velocity) > 10.0)
         new_me.velocity = normalize(new_me.velocity) * 10.0;
     new_me.velocity = mix(me.velocity, new_me.velocity, 0.4);
-    output_data.member[global_id] = new_me;
+    store_member(global_id, new_me);
 }
@@ -0,0 +1,98 @@
+#version 430 core
+
+// FLOCK_SIZE, LOCAL_SIZE and TABLE_SIZE are injected by the host, and
+// SOA_LAYOUT when the flock is stored as separate position and velocity
+// streams instead of flock_member records
+
+layout (local_size_x = LOCAL_SIZE) in;
+
+uniform float cell_size;
+
+struct flock_member
+{
+    vec3 position;
+    vec3 velocity;
+};
+
+#ifdef SOA_LAYOUT
+layout (std430, binding = 0) readonly buffer positions_in
+{
+    float position[];
+} input_position;
+
+vec3 load_position(uint i)
+{
+    return vec3(input_position.position[3 * i],
+                input_position.position[3 * i + 1],
+                input_position.position[3 * i + 2]);
+}
+#else
+layout (std430, binding = 0) readonly buffer members_in
+{
+    flock_member member[];
+} input_data;
+
+vec3 load_position(uint i)
+{
+    return input_data.member[i].position;
+}
+#endif
+
+// Hashed cell of every member and its rank among the members of that cell
+layout (std430, binding = 1) writeonly buffer members_cell
+{
+    uvec2 cell_rank[];
+};
+
+// Cleared by the host before every dispatch
+layout (std430, binding = 2) buffer cell_counts
+{
+    uint cell_count[];
+};
+
+// Sum of the positions of every workgroup, reduced by flock_center_cs.glsl
+layout (std430, binding = 3) writeonly buffer partial_centers
+{
+    vec4 partial_center[];
+};
+
+shared vec3 shared_position[gl_WorkGroupSize.x];
+
+// TABLE_SIZE is a power of two
+uint cell_hash(ivec3 cell)
+{
+    return (uint(cell.x) * 73856093u ^
+            uint(cell.y) * 19349663u ^
+            uint(cell.z) * 83492791u) & (TABLE_SIZE - 1u);
+}
+
+void main(void)
+{
+    uint global_id = gl_GlobalInvocationID.x;
+    uint local_id  = gl_LocalInvocationID.x;
+
+    vec3 position = vec3(0.0);
+
+    // The last workgroup may be partial, its extra invocations still take
+    // part in the reduction
+    if (global_id < FLOCK_SIZE)
+    {
+        position = load_position(global_id);
+        uint cell = cell_hash(ivec3(floor(position / cell_size)));
+
+        cell_rank[global_id] = uvec2(cell, atomicAdd(cell_count[cell], 1u));
+    }
+
+    shared_position[local_id] = position;
+    barrier();
+
+    for (uint stride = gl_WorkGroupSize.x / 2; stride > 0; stride >>= 1)
+    {
+        if (local_id < stride)
+            shared_position[local_id] += shared_position[local_id + stride];
+        barrier();
+    }
+
+    if (local_id == 0)
+        partial_center[gl_WorkGroupID.x] = vec4(shared_position[0], 0.0);
+}
@@ -0,0 +1,89 @@
+#version 430 core
+
+// FLOCK_SIZE, LOCAL_SIZE and TABLE_SIZE are injected by the host, and
+// SOA_LAYOUT when the flock is stored as separate position and velocity
+// streams instead of flock_member records
+
+layout (local_size_x = LOCAL_SIZE) in;
+
+struct flock_member
+{
+    vec3 position;
+    vec3 velocity;
+};
+
+// The original index is kept in the padding after the position
+struct sorted_member
+{
+    vec3 position;
+    uint index;
+    vec3 velocity;
+};
+
+#ifdef SOA_LAYOUT
+layout (std430, binding = 0) readonly buffer positions_in
+{
+    float position[];
+} input_position;
+
+layout (std430, binding = 6) readonly buffer velocities_in
+{
+    float velocity[];
+} input_velocity;
+
+flock_member load_member(uint i)
+{
+    flock_member m;
+    m.position = vec3(input_position.position[3 * i],
+                      input_position.position[3 * i + 1],
+                      input_position.position[3 * i + 2]);
+    m.velocity = vec3(input_velocity.velocity[3 * i],
+                      input_velocity.velocity[3 * i + 1],
+                      input_velocity.velocity[3 * i + 2]);
+    return m;
+}
+#else
+layout (std430, binding = 0) readonly buffer members_in
+{
+    flock_member member[];
+} input_data;
+
+flock_member load_member(uint i)
+{
+    return input_data.member[i];
+}
+#endif
+
+layout (std430, binding = 1) readonly buffer members_cell
+{
+    uvec2 cell_rank[];
+};
+
+// Exclusive scan of the cell counts
+layout (std430, binding = 2) readonly buffer cell_starts
+{
+    uint cell_start[];
+};
+
+layout (std430, binding = 3) writeonly buffer members_sorted
+{
+    sorted_member member[];
+} sorted_data;
+
+void main(void)
+{
+    uint global_id = gl_GlobalInvocationID.x;
+
+    if (global_id >= FLOCK_SIZE)
+        return;
+
+    flock_member me = load_member(global_id);
+    uvec2 cell = cell_rank[global_id];
+
+    sorted_member sorted;
+    sorted.position = me.position;
+    sorted.index    = global_id;
+    sorted.velocity = me.velocity;
+
+    sorted_data.member[cell_start[cell.x] + cell.y] = sorted;
+}
@@ -1,6 +1,9 @@
 #include <iostream>
 #include <cstdlib>
+#include <cmath>
 #include <vector>
+#include <array>
+#include <string>
 #include <random>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -9,19 +12,45 @@
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "context.h"
+#include "buffer.h"
+#include "compute.h"
+#include "cpu.h"
+#include "random.h"
+#include "readback.h"
 #include "shaderprogram.h"
+#include "threadpool.h"
 #include "camera.h"
 
 constexpr GLuint WIDTH  = 512;
 constexpr GLuint HEIGHT = 512;
 
-enum
-{
-    WORKGROUP_SIZE  = 256,
-    NUM_WORKGROUPS  = 64,
-    FLOCK_SIZE      = (NUM_WORKGROUPS * WORKGROUP_SIZE)
-};
+// Members closer than the square root of this are neighbors, it is also the
+// side of the cells of the spatial hash
+constexpr GLfloat CLOSEST_ALLOWED_DIST = 50.0F;
+
+// Defaults, all of them can be overridden from the command line:
+// SBFlocking [flock size] [workgroup size] [aos|soa]
+constexpr GLuint FLOCK_SIZE     = 1 << 20;
+constexpr GLuint WORKGROUP_SIZE = 256;
+constexpr const char* LAYOUT    = "aos";
+
+// The simulation advances in fixed ticks independent of the frame rate,
+// frames that fall behind run several ticks, up to MAX_TICKS_PER_FRAME
+// before dropping time so a slow frame doesn't make the next one slower
+constexpr GLfloat TICK_DURATION       = 1.0F / 60.0F;
+constexpr GLuint  MAX_TICKS_PER_FRAME = 4;
+
+// Members generated by each task of the initialization
+constexpr GLuint INIT_GRAIN = 1 << 14;
+
+// Relative tolerance of the check of the first tick against the CPU backend,
+// the sums over the neighbors and the flock center are accumulated in a
+// different order
+constexpr GLfloat CHECK_TOLERANCE = 1e-4F;
 
+// Record of the AoS layout, the SoA layout stores positions and velocities
+// as tightly packed vec3 streams instead
 struct flock_member
 {
     glm::vec3 position;
@@ -33,62 +62,125 @@ struct flock_member
 GLvoid error_callback(GLint error, const GLchar* description);
 GLvoid createQuad(GLuint& vao, GLuint& vbo, GLuint& ebo);
 
-int main()
+int main(int argc, char* argv[])
 {
-    glfwSetErrorCallback(error_callback);
+    GLuint flockSize     = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : FLOCK_SIZE;
+    GLuint workgroupSize = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : WORKGROUP_SIZE;
+    std::string layout   = argc > 3 ? argv[3] : LAYOUT;
+
+    if(layout != "aos" && layout != "soa")
+    {
+        std::cerr << "Unknown layout " << layout << ", available: aos soa\n";
+
+        exit(1);
+    }
 
-    glfwInit();
+    GLboolean soa = layout == "soa";
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    glfwSetErrorCallback(error_callback);
+
+    simgll::Context context(simgll::Context::Type::Window, WIDTH, HEIGHT,
+                            "OpenGL App", 4, 3);
+    GLFWwindow* window = context.window();
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "OpenGL App",
-                                          nullptr, nullptr);
+    // The reductions in the shaders need a power of two workgroup size
+    GLint maxInvocations;
+    GLint maxGroups;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxGroups);
 
-    if(!window)
+    if(flockSize == 0 || workgroupSize == 0 ||
+       (workgroupSize & (workgroupSize - 1)) != 0 ||
+       workgroupSize > static_cast<GLuint>(maxInvocations))
     {
-        glfwTerminate();
+        std::cerr << "Invalid flock size or workgroup size\n";
+
         exit(1);
     }
 
-    glfwMakeContextCurrent(window);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    glewExperimental = GL_TRUE;
-    GLenum status = glewInit();
+    // The last workgroup is partial when the flock size isn't a multiple of
+    // the workgroup size
+    GLuint numWorkgroups = (flockSize + workgroupSize - 1) / workgroupSize;
 
-    if(status != GLEW_OK)
+    if(numWorkgroups > static_cast<GLuint>(maxGroups))
     {
-        glfwTerminate();
+        std::cerr << "A flock of " << flockSize << " needs more than "
+                  << maxGroups << " workgroups\n";
+
         exit(1);
     }
 
+    // Number of hashed cells, a power of two with a low load factor
+    GLuint tableSize = 1;
+
+    while(tableSize < 2 * flockSize)
+    {
+        tableSize <<= 1;
+    }
+
+    // Sizes are compiled into the compute shaders
+    std::string defines = "#define FLOCK_SIZE " + std::to_string(flockSize) + "u\n" +
+                          "#define LOCAL_SIZE " + std::to_string(workgroupSize) + "\n" +
+                          "#define TABLE_SIZE " + std::to_string(tableSize) + "u\n" +
+                          (soa ? "#define SOA_LAYOUT\n" : "");
+
     simgll::Camera camera(window,
                   glm::vec3{ 0.0f, 0.5f, -400.0f },
                   glm::vec3{ 0.0f, 0.0f,    1.0f },
                   glm::vec3{ 0.0f, 1.0f,    0.0f });
 
+    // Both programs are compiled in the background while the buffers are
+    // initialized, getLocation() waits for them to finish
     simgll::ShaderProgram flockUpdateProgram;
-    flockUpdateProgram.addShader("flocking_cs.glsl", GL_COMPUTE_SHADER);
-    flockUpdateProgram.compile();
-
-    GLint goalLocation = flockUpdateProgram.getLocation("goal");
+    flockUpdateProgram.addShader("flocking_cs.glsl", GL_COMPUTE_SHADER,
+                                 defines);
+    flockUpdateProgram.compileAsync();
+
+    // The neighbor search bins the flock in a uniform grid every frame: the
+    // members of each hashed cell are counted, the counts are scanned into
+    // cell start offsets and the members are copied in cell order
+    simgll::ShaderProgram gridCountProgram;
+    gridCountProgram.addShader("grid_count_cs.glsl", GL_COMPUTE_SHADER,
+                               defines);
+    gridCountProgram.compileAsync();
+
+    simgll::ShaderProgram gridScatterProgram;
+    gridScatterProgram.addShader("grid_scatter_cs.glsl", GL_COMPUTE_SHADER,
+                                 defines);
+    gridScatterProgram.compileAsync();
+
+    simgll::ShaderProgram flockCenterProgram;
+    flockCenterProgram.addShader("flock_center_cs.glsl", GL_COMPUTE_SHADER,
+                                 defines);
+    flockCenterProgram.compileAsync();
+
+    simgll::compute::Scan cellScan(simgll::compute::Type::Uint, GL_FALSE);
 
     simgll::ShaderProgram renderProgram;
     renderProgram.addShader("vertex_shader.glsl",   GL_VERTEX_SHADER);
     renderProgram.addShader("fragment_shader.glsl", GL_FRAGMENT_SHADER);
-    renderProgram.compile();
+    renderProgram.compileAsync();
+
+    // With the AoS layout both streams are the flock_member records of one
+    // buffer, with the SoA layout they are separate buffers so kernels and
+    // draws only fetch what they use
+    GLuint position_buffers[2];
+    GLuint velocity_buffers[2];
+    glGenBuffers(2, position_buffers);
 
-    GLint mvpLocation = renderProgram.getLocation("mvp");
+    if(soa)
+    {
+        glGenBuffers(2, velocity_buffers);
+    }
+    else
+    {
+        velocity_buffers[0] = position_buffers[0];
+        velocity_buffers[1] = position_buffers[1];
+    }
 
-    GLuint flock_buffers[2];
-    glGenBuffers(2, flock_buffers);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, flock_buffers[0]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, FLOCK_SIZE * sizeof(flock_member), nullptr, GL_DYNAMIC_COPY);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, flock_buffers[1]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, FLOCK_SIZE * sizeof(flock_member), nullptr, GL_DYNAMIC_COPY);
+    GLsizei stride          = soa ? sizeof(glm::vec3) : sizeof(flock_member);
+    GLintptr velocityOffset = soa ? 0 : sizeof(glm::vec4);
 
     // This is position and normal data for a paper airplane
     static const glm::vec3 geometry[] =
@@ -130,78 +222,282 @@ int main()
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)(8 * sizeof(glm::vec3)));
 
-        glBindBuffer(GL_ARRAY_BUFFER, flock_buffers[i]);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(flock_member), nullptr);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(flock_member), (GLvoid*)sizeof(glm::vec4));
-        glVertexAttribDivisor(2, 1);
-        glVertexAttribDivisor(3, 1);
-
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-        glEnableVertexAttribArray(3);
+        // The flock is drawn between the state of the last tick, in the
+        // buffers i, and the state before it
+        glBindBuffer(GL_ARRAY_BUFFER, position_buffers[i]);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
+        glBindBuffer(GL_ARRAY_BUFFER, velocity_buffers[i]);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)velocityOffset);
+
+        glBindBuffer(GL_ARRAY_BUFFER, position_buffers[i ^ 1]);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
+        glBindBuffer(GL_ARRAY_BUFFER, velocity_buffers[i ^ 1]);
+        glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)velocityOffset);
+
+        for(GLuint attrib = 2; attrib < 6; attrib++)
+        {
+            glVertexAttribDivisor(attrib, 1);
+        }
+
+        for(GLuint attrib = 0; attrib < 6; attrib++)
+        {
+            glEnableVertexAttribArray(attrib);
+        }
     }
 
-    glBindBuffer(GL_ARRAY_BUFFER, flock_buffers[0]);
-    flock_member* ptr = reinterpret_cast<flock_member*>(
-                glMapBufferRange(GL_ARRAY_BUFFER, 0,
-                                 FLOCK_SIZE * sizeof(flock_member),
-                                 GL_MAP_WRITE_BIT |
-                                 GL_MAP_INVALIDATE_BUFFER_BIT));
-
     std::random_device rd;
-    std::mt19937 engine(rd());
-    std::uniform_real_distribution<> dist(0.0, 1.0);
+    GLuint seed = rd();
+
+    std::vector<glm::vec3> positions(flockSize);
+    std::vector<glm::vec3> velocities(flockSize);
 
-    for(int i = 0; i < FLOCK_SIZE; i++)
+    simgll::ThreadPool::global().parallelFor(0, flockSize, INIT_GRAIN,
+        [&](std::size_t first, std::size_t last)
     {
-        ptr[i].position.x = (dist(engine) - 0.5f) * 300.0f;
-        ptr[i].position.y = (dist(engine) - 0.5f) * 300.0f;
-        ptr[i].position.z = (dist(engine) - 0.5f) * 300.0f;
+        for(std::size_t i = first; i < last; i++)
+        {
+            // Counter 0 for the position and 1 for the velocity
+            std::array<GLuint, 4> r = simgll::philox(seed, static_cast<GLuint>(i), 0);
+
+            positions[i].x = (simgll::uniformFloat(r[0]) - 0.5f) * 300.0f;
+            positions[i].y = (simgll::uniformFloat(r[1]) - 0.5f) * 300.0f;
+            positions[i].z = (simgll::uniformFloat(r[2]) - 0.5f) * 300.0f;
+
+            r = simgll::philox(seed, static_cast<GLuint>(i), 1);
+
+            velocities[i].x = simgll::uniformFloat(r[0]) - 0.5f;
+            velocities[i].y = simgll::uniformFloat(r[1]) - 0.5f;
+            velocities[i].z = simgll::uniformFloat(r[2]) - 0.5f;
+        }
+    });
 
-        ptr[i].velocity.x = dist(engine) - 0.5f;
-        ptr[i].velocity.y = dist(engine) - 0.5f;
-        ptr[i].velocity.z = dist(engine) - 0.5f;
+    // Both states start equal so the first frames interpolate correctly
+    if(soa)
+    {
+        for(int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, position_buffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, flockSize * sizeof(glm::vec3), positions.data(), GL_DYNAMIC_COPY);
+            glBindBuffer(GL_ARRAY_BUFFER, velocity_buffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, flockSize * sizeof(glm::vec3), velocities.data(), GL_DYNAMIC_COPY);
+        }
+    }
+    else
+    {
+        std::vector<flock_member> members(flockSize);
+
+        simgll::ThreadPool::global().parallelFor(0, flockSize, INIT_GRAIN,
+            [&](std::size_t first, std::size_t last)
+        {
+            for(std::size_t i = first; i < last; i++)
+            {
+                members[i].position = positions[i];
+                members[i].velocity = velocities[i];
+            }
+        });
+
+        for(int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, position_buffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, flockSize * sizeof(flock_member), members.data(), GL_DYNAMIC_COPY);
+        }
     }
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    simgll::Buffer<glm::uvec2> cellBuffer(flockSize);
+    simgll::Buffer<GLuint> cellCountBuffer(tableSize);
+    simgll::Buffer<GLuint> cellStartBuffer(tableSize);
+    simgll::Buffer<flock_member> sortedBuffer(flockSize);
+    simgll::Buffer<glm::vec4> partialCenterBuffer(numWorkgroups);
+    simgll::Buffer<glm::vec4> centerBuffer(1);
+
+    GLfloat cellSize = std::sqrt(CLOSEST_ALLOWED_DIST);
+
+    gridCountProgram.set("cell_size", cellSize);
+
+    flockCenterProgram.set("num_partials", numWorkgroups);
+
+    flockUpdateProgram.set("closest_allowed_dist", CLOSEST_ALLOWED_DIST);
+    flockUpdateProgram.set("cell_size", cellSize);
+
+    GLint goalLocation  = flockUpdateProgram.getLocation("goal");
+    GLint mvpLocation   = renderProgram.getLocation("mvp");
+    GLint alphaLocation = renderProgram.getLocation("alpha");
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
     glViewport(0, 0, WIDTH, HEIGHT);
     glClearColor(0.0F, 0.0F, 0.0F, 1.0F);
 
-    GLfloat startTime = 0.0F;
-    GLfloat oldTime   = 0.0F;
-    GLfloat deltaTime = 0.0F;
-
     GLuint frameIndex = 0;
 
-    while(!glfwWindowShouldClose(window))
+    // The goal follows the simulation clock, not the frame rate
+    auto goalAt = [](GLfloat time)
+    {
+        glm::vec3 goal = glm::vec3(sinf(time * 0.34f),
+                                   cosf(time * 0.29f),
+                                   sinf(time * 0.12f) * cosf(time * 0.5f));
+
+        return goal * glm::vec3(35.0f, 25.0f, 60.0f);
+    };
+
+    // Reference for the first tick computed by the multi-threaded CPU
+    // backend, with the same grid and parameters as the shaders
+    std::vector<simgll::cpu::FlockMember> reference(flockSize);
+    {
+        std::vector<simgll::cpu::FlockMember> initial(flockSize);
+
+        for(GLuint i = 0; i < flockSize; i++)
+        {
+            for(GLint d = 0; d < 3; d++)
+            {
+                initial[i].position[d] = positions[i][d];
+                initial[i].velocity[d] = velocities[i][d];
+            }
+        }
+
+        simgll::cpu::FlockParameters parameters;
+        glm::vec3 goal = goalAt(0.0f);
+
+        parameters.closestAllowedDist = CLOSEST_ALLOWED_DIST;
+
+        for(GLint d = 0; d < 3; d++)
+        {
+            parameters.goal[d] = goal[d];
+        }
+
+        simgll::cpu::flockUpdate(initial.data(), reference.data(), flockSize,
+                                 parameters, tableSize);
+    }
+
+    // Both streams are read with the stride of either layout, velocities
+    // start at velocityOffset in the records of the AoS layout
+    simgll::ReadbackQueue check(flockSize * stride, 2);
+    std::size_t mismatches = 0;
+
+    const std::size_t recordFloats =
+        sizeof(simgll::cpu::FlockMember) / sizeof(GLfloat);
+
+    auto checkPositions = [&](const GLvoid* data, GLsizeiptr)
+    {
+        mismatches += simgll::cpu::countMismatches(
+            static_cast<const GLfloat*>(data), stride / sizeof(GLfloat),
+            reference[0].position, recordFloats, flockSize, 3,
+            CHECK_TOLERANCE);
+    };
+
+    auto checkVelocities = [&](const GLvoid* data, GLsizeiptr)
+    {
+        mismatches += simgll::cpu::countMismatches(
+            static_cast<const GLfloat*>(data) + velocityOffset / sizeof(GLfloat),
+            stride / sizeof(GLfloat), reference[0].velocity, recordFloats,
+            flockSize, 3, CHECK_TOLERANCE);
+
+        std::cout << "First tick: " << mismatches
+                  << " mismatches against the CPU backend\n";
+    };
+
+    // One tick reads the buffers frameIndex and writes the other ones
+    auto tick = [&](GLfloat time)
+    {
+        // Bin the flock and find its center
+        cellCountBuffer.clear();
+
+        gridCountProgram.use();
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, position_buffers[frameIndex]);
+        cellBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+        cellCountBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+        partialCenterBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+
+        glDispatchCompute(numWorkgroups, 1, 1);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        flockCenterProgram.use();
+
+        partialCenterBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+        centerBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+
+        glDispatchCompute(1, 1, 1);
+
+        cellScan.run(cellCountBuffer.name(), cellStartBuffer.name(),
+                     tableSize);
+
+        gridScatterProgram.use();
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, position_buffers[frameIndex]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, velocity_buffers[frameIndex]);
+        cellBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+        cellStartBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+        sortedBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+
+        glDispatchCompute(numWorkgroups, 1, 1);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        flockUpdateProgram.use();
+
+        flockUpdateProgram.set(goalLocation, goalAt(time));
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, position_buffers[frameIndex]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, position_buffers[frameIndex ^ 1]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, velocity_buffers[frameIndex]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, velocity_buffers[frameIndex ^ 1]);
+        sortedBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+        cellStartBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+        cellCountBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+        centerBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+
+        glDispatchCompute(numWorkgroups, 1, 1);
+
+        // The new state is read by the next tick as a storage buffer and
+        // by the draw as vertex attributes
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT |
+                        GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+        frameIndex ^= 1;
+    };
+
+    GLfloat oldTime     = (GLfloat)glfwGetTime();
+    GLfloat deltaTime   = 0.0F;
+    GLfloat accumulator = 0.0F;
+    GLuint  numTicks    = 0;
+
+    while(!context.shouldClose())
     {
-        startTime = (GLfloat)glfwGetTime();
+        GLfloat startTime = (GLfloat)glfwGetTime();
         deltaTime = startTime - oldTime;
         oldTime   = startTime;
 
-        glfwPollEvents();
+        context.pollEvents();
+        check.poll();
 
         static const float black[] = { 0.0F, 0.0F, 0.0F, 1.0F };
         static const float one = 1.0F;
 
-        flockUpdateProgram.use();
-
-        glm::vec3 goal = glm::vec3(sinf(deltaTime * 0.34f),
-                                   cosf(deltaTime * 0.29f),
-                                   sinf(deltaTime * 0.12f) * cosf(deltaTime * 0.5f));
+        accumulator += deltaTime;
 
-        goal = goal * glm::vec3(35.0f, 25.0f, 60.0f);
+        for(GLuint i = 0; accumulator >= TICK_DURATION; i++)
+        {
+            if(i == MAX_TICKS_PER_FRAME)
+            {
+                accumulator = 0.0F;
+                break;
+            }
 
-        glUniform3f(goalLocation, goal.x, goal.y, goal.z);
+            tick(numTicks * TICK_DURATION);
 
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, flock_buffers[frameIndex]);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, flock_buffers[frameIndex ^ 1]);
+            if(numTicks == 0)
+            {
+                check.enqueue(position_buffers[frameIndex], 0,
+                              flockSize * stride, checkPositions);
+                check.enqueue(velocity_buffers[frameIndex], 0,
+                              flockSize * stride, checkVelocities);
+            }
 
-        glDispatchCompute(NUM_WORKGROUPS, 1, 1);
+            accumulator -= TICK_DURATION;
+            numTicks++;
+        }
 
         glViewport(0, 0, WIDTH, HEIGHT);
         glClearBufferfv(GL_COLOR, 0, black);
@@ -210,18 +506,17 @@ int main()
         renderProgram.use();
         auto mvp = camera.update(deltaTime, 45.0F, 0.1F, 3000.0F);
 
-        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &mvp[0][0]);
+        renderProgram.set(mvpLocation, mvp);
 
-        glBindVertexArray(flock_render_vaos[frameIndex]);
-        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 8, FLOCK_SIZE);
+        // Fraction of a tick elapsed since the last one
+        renderProgram.set(alphaLocation, accumulator / TICK_DURATION);
 
-        frameIndex ^= 1;
+        glBindVertexArray(flock_render_vaos[frameIndex]);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 8, flockSize);
 
-        glfwSwapBuffers(window);
+        context.swapBuffers();
     }
 
-    glfwTerminate();
-
     return 0;
 }
 
@@ -6,6 +6,10 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec3 bird_position;
 layout (location = 3) in vec3 bird_velocity;
 
+// State of the previous simulation tick
+layout (location = 4) in vec3 previous_position;
+layout (location = 5) in vec3 previous_velocity;
+
 out VS_OUT
 {
     flat vec3 color;
@@ -13,6 +17,9 @@ out VS_OUT
 
 uniform mat4 mvp;
 
+// Fraction of a tick elapsed since the last one
+uniform float alpha = 1.0;
+
 mat4 make_lookat(vec3 forward, vec3 up)
 {
     vec3 side = cross(forward, up);
@@ -35,9 +42,12 @@ vec3 choose_color(float f)
 
 void main(void)
 {
-    mat4 lookat = make_lookat(normalize(bird_velocity), vec3(0.0, 1.0, 0.0));
+    vec3 velocity = mix(previous_velocity, bird_velocity, alpha);
+    vec3 center = mix(previous_position, bird_position, alpha);
+
+    mat4 lookat = make_lookat(normalize(velocity), vec3(0.0, 1.0, 0.0));
     vec4 obj_coord = lookat * vec4(position.xyz, 1.0);
-    gl_Position = mvp * (obj_coord + vec4(bird_position, 0.0));
+    gl_Position = mvp * (obj_coord + vec4(center, 0.0));
 
     vec3 N = mat3(lookat) * normal;
     vec3 C = choose_color(fract(float(gl_InstanceID / float(1237.0))));
@@ -1,10 +1,13 @@
 #include <iostream>
 #include <cstdlib>
 #include <vector>
-#include <ctime>
+#include <random>
+#include <string>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "assetpack.h"
+#include "random.h"
 #include "shaderprogram.h"
 
 constexpr GLuint WIDTH = 512, HEIGHT = 512;
@@ -16,8 +19,6 @@ GLuint createTextureObject(GLuint width, GLuint height);
 
 int main()
 {
-    srand(time(nullptr));
-
     glfwSetErrorCallback(error_callback);
 
     glfwInit();
@@ -53,17 +54,38 @@ int main()
         exit(1);
     }
 
+    simgll::AssetPack shaders;
+    std::string error;
+
+    if(!shaders.open("shaders.pack", error))
+    {
+        std::cerr << error << "\n";
+
+        glfwTerminate();
+
+        exit(1);
+    }
+
     simgll::ShaderProgram computeProgram;
-    computeProgram.addShader("compute_shader.glsl", GL_COMPUTE_SHADER);
+    computeProgram.addShader(shaders, "compute_shader.glsl", GL_COMPUTE_SHADER,
+                             simgll::philoxGlsl());
     computeProgram.compile();
 
-    GLint cpuSeedLocation = computeProgram.getLocation("cpuSeed");
+    GLint seedLocation  = computeProgram.getLocation("seed");
+    GLint frameLocation = computeProgram.getLocation("frame");
+    GLuint frame = 0;
+
+    std::random_device rd;
+    computeProgram.set(seedLocation, static_cast<GLuint>(rd()));
 
     simgll::ShaderProgram renderProgram;
-    renderProgram.addShader("vertex_shader.glsl", GL_VERTEX_SHADER);
-    renderProgram.addShader("fragment_shader.glsl", GL_FRAGMENT_SHADER);
+    renderProgram.addShader(shaders, "vertex_shader.glsl", GL_VERTEX_SHADER);
+    renderProgram.addShader(shaders, "fragment_shader.glsl", GL_FRAGMENT_SHADER);
     renderProgram.compile();
 
+    // The sources were handed to GL, the mapping isn't needed anymore
+    shaders.close();
+
     GLuint vao, vbo, ebo;
     createQuad(vao, vbo, ebo);
 
@@ -86,7 +108,7 @@ int main()
         glBindImageTexture(0, ping, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8UI);
         glBindImageTexture(1, pong, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8UI);
 
-        glUniform1ui(cpuSeedLocation, rand());
+        computeProgram.set(frameLocation, frame++);
 
         glDispatchCompute(TEXTURE_WIDTH / 32, TEXTURE_HEIGHT / 32, 1);
 
@@ -0,0 +1,89 @@
+#version 450 core
+
+// One work group per tile of 16x16 blades, the tile is culled and given a
+// level of detail as a whole
+layout (local_size_x = 16, local_size_y = 16) in;
+
+struct DrawArraysIndirectCommand
+{
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+// One command per level of detail, their instances are stored from
+// baseInstance on in the instance list
+layout (std430, binding = 0) buffer draw_commands
+{
+    DrawArraysIndirectCommand commands[];
+};
+
+layout (std430, binding = 1) writeonly buffer visible_instances
+{
+    uint instances[];
+};
+
+uniform mat4 mvp;
+uniform vec3 eye;
+uniform float lod_distance = 200.0;
+
+// Blades are at most 4 units high and reach 2.1 units around their root
+// with the bend and the rotation, their root is jittered by up to 1 unit
+const float BLADE_HEIGHT = 4.0;
+const float BLADE_REACH  = 2.5;
+
+shared bool visible;
+shared uint first_instance;
+
+// Whether the box is entirely behind the plane
+bool outside(vec4 plane, vec3 box_min, vec3 box_max)
+{
+    // Corner of the box the farthest along the normal
+    vec3 corner = mix(box_min, box_max, greaterThan(plane.xyz, vec3(0.0)));
+
+    return dot(plane.xyz, corner) + plane.w < 0.0;
+}
+
+void main(void)
+{
+    uvec2 blade = gl_GlobalInvocationID.xy;
+
+    if(gl_LocalInvocationIndex == 0)
+    {
+        vec2 tile_min = vec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy) - 512.0;
+        vec2 tile_max = tile_min + vec2(gl_WorkGroupSize.xy) + 1.0;
+
+        vec3 box_min = vec3(tile_min.x - BLADE_REACH, 0.0, tile_min.y - BLADE_REACH);
+        vec3 box_max = vec3(tile_max.x + BLADE_REACH, BLADE_HEIGHT,
+                            tile_max.y + BLADE_REACH);
+
+        // Frustum planes from the rows of the matrix
+        mat4 rows = transpose(mvp);
+
+        visible = !(outside(rows[3] + rows[0], box_min, box_max) ||
+                    outside(rows[3] - rows[0], box_min, box_max) ||
+                    outside(rows[3] + rows[1], box_min, box_max) ||
+                    outside(rows[3] - rows[1], box_min, box_max) ||
+                    outside(rows[3] + rows[2], box_min, box_max) ||
+                    outside(rows[3] - rows[2], box_min, box_max));
+
+        if(visible)
+        {
+            vec3 center = (box_min + box_max) * 0.5;
+            uint lod    = distance(eye, center) > lod_distance ? 1 : 0;
+
+            // A single atomic reserves the slots of the whole tile
+            first_instance = commands[lod].baseInstance +
+                             atomicAdd(commands[lod].instanceCount,
+                                       gl_WorkGroupSize.x * gl_WorkGroupSize.y);
+        }
+    }
+
+    barrier();
+
+    if(visible)
+    {
+        instances[first_instance + gl_LocalInvocationIndex] = (blade.x << 10) | blade.y;
+    }
+}
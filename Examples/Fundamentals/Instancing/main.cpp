@@ -1,49 +1,62 @@
 #include <iostream>
+#include <algorithm>
+#include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "context.h"
+#include "buffer.h"
 #include "shaderprogram.h"
 #include "camera.h"
+#include "random.h"
+#include "texture.h"
 
 constexpr GLuint WIDTH = 512, HEIGHT = 512;
 
-void error_cb(GLint error, const GLchar* description);
-
-int main()
-{
-    glfwSetErrorCallback(error_cb);
+// Data driving the blades, sampled at their position on the field
+constexpr GLsizei FIELD_SIZE = 1024, PALETTE_SIZE = 256;
+constexpr GLuint FIELD_SEED = 1234;
 
-    glfwInit();
+// Blades are culled in tiles of TILE_SIZE x TILE_SIZE, it must match the
+// work group size of cull.glsl
+constexpr GLuint BLADE_COUNT = 1024 * 1024;
+constexpr GLuint TILE_SIZE   = 16;
+constexpr GLuint TILE_COUNT  = 1024 / TILE_SIZE;
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "OpenGL App",
-                                          nullptr, nullptr);
-
-    if(!window)
-    {
-        glfwTerminate();
-        return 1;
-    }
+// Mirrors the draw_commands block of cull.glsl, one command per level of
+// detail whose instances start at baseInstance in the instance list
+struct DrawArraysIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
 
-    glfwMakeContextCurrent(window);
+enum FieldLayer
+{
+    LENGTH_LAYER,
+    ORIENTATION_LAYER,
+    COLOR_LAYER,
+    BEND_LAYER,
+    FIELD_LAYERS
+};
 
-    glewExperimental = GL_TRUE;
-    GLenum status = glewInit();
+void error_cb(GLint error, const GLchar* description);
+std::vector<GLubyte> createField(GLuint layer);
+std::vector<GLubyte> createPalette();
 
-    if(status != GLEW_OK)
-    {
-        std::cerr << "GLEW Error: " << glewGetErrorString(status) << "\n";
+int main()
+{
+    glfwSetErrorCallback(error_cb);
 
-        return 1;
-    }
+    simgll::Context context(simgll::Context::Type::Window, WIDTH, HEIGHT,
+                            "OpenGL App", 4, 5);
 
+    // Full blade, then a single triangle for the distant tiles
     const GLfloat grassBlade[] =
     {
         -0.3f,  0.0f,
@@ -51,9 +64,27 @@ int main()
         -0.2f,  1.0f,
          0.1f,  1.3f,
         -0.05f, 2.3f,
+         0.0f,  3.3f,
+
+        -0.3f,  0.0f,
+         0.3f,  0.0f,
          0.0f,  3.3f
     };
 
+    const DrawArraysIndirectCommand lods[] =
+    {
+        { 6, 0, 0, 0 },
+        { 3, 0, 6, BLADE_COUNT }
+    };
+
+    constexpr GLsizei LOD_COUNT = sizeof(lods) / sizeof(lods[0]);
+
+    // Rewritten by the culling pass every frame
+    simgll::Buffer<DrawArraysIndirectCommand> commandBuffer(LOD_COUNT,
+                                                            GL_DYNAMIC_STORAGE_BIT,
+                                                            lods);
+    simgll::Buffer<GLuint> instanceBuffer(LOD_COUNT * BLADE_COUNT);
+
     GLuint grassBuffer;
     glGenBuffers(1, &grassBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, grassBuffer);
@@ -66,47 +97,100 @@ int main()
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
     glEnableVertexAttribArray(0);
 
+    // The visible blades, the base instance of each command selects its
+    // part of the list
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.name());
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, 0, nullptr);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+
+    simgll::ShaderProgram cullProgram;
+    cullProgram.addShader("cull.glsl", GL_COMPUTE_SHADER);
+    cullProgram.compile();
+
+    GLint cullMvpLocation = cullProgram.getLocation("mvp");
+    GLint eyeLocation     = cullProgram.getLocation("eye");
+
     simgll::ShaderProgram renderProgram;
-    renderProgram.addShader("vertex_shader.glsl",   GL_VERTEX_SHADER);
+    renderProgram.addShader("vertex_shader.glsl",   GL_VERTEX_SHADER,
+                            simgll::bindlessGlsl());
     renderProgram.addShader("fragment_shader.glsl", GL_FRAGMENT_SHADER);
     renderProgram.compile();
 
     GLint mvpLocation = renderProgram.getLocation("mvp");
 
+    // Every field is a layer of a single array, uploaded once
+    simgll::TextureArray fields(GL_R8, FIELD_SIZE, FIELD_SIZE, FIELD_LAYERS);
+
+    for(GLint layer = 0; layer < FIELD_LAYERS; layer++)
+    {
+        std::vector<GLubyte> field = createField(layer);
+        fields.setLayer(layer, GL_RED, GL_UNSIGNED_BYTE, field.data());
+    }
+
+    simgll::TextureArray palette(GL_RGBA8, PALETTE_SIZE, 1, 1);
+    palette.setLayer(0, GL_RGBA, GL_UNSIGNED_BYTE, createPalette().data());
+
+    // The textures are referenced once here, draws never rebind them
+    if(simgll::bindlessSupported())
+    {
+        renderProgram.setHandle("fields",  fields.handle());
+        renderProgram.setHandle("palette", palette.handle());
+    }
+    else
+    {
+        fields.bind(0);
+        palette.bind(1);
+    }
+
     glViewport(0, 0, WIDTH, HEIGHT);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
 
-    glActiveTexture(GL_TEXTURE1);
-    glActiveTexture(GL_TEXTURE2);
-    glActiveTexture(GL_TEXTURE3);
-    glActiveTexture(GL_TEXTURE4);
-
-
-    while(!glfwWindowShouldClose(window))
+    while(!context.shouldClose())
     {
         GLfloat t = static_cast<GLfloat>(glfwGetTime()) * 0.02f;
         GLfloat r = 550.0f;
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glfwPollEvents();
+        context.pollEvents();
+
+        glm::vec3 eye(sinf(t) * r, 25.0f, cosf(t) * r);
 
-        auto mv = glm::lookAt(glm::vec3(sinf(t) * r, 25.0f, cosf(t) * r),
+        auto mv = glm::lookAt(eye,
                               glm::vec3(0.0f, -50.0f, 0.0f),
                               glm::vec3(0.0f, 1.0f, 0.0f));
         auto prj = glm::perspective(45.0f, (GLfloat)(WIDTH) / HEIGHT, 0.1f, 1000.0f);
         auto mvp = prj * mv;
 
+        // Empty the instance lists, then keep the tiles in the frustum
+        commandBuffer.upload(lods, LOD_COUNT);
+
+        commandBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+        instanceBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+
+        cullProgram.use();
+        cullProgram.set(cullMvpLocation, mvp);
+        cullProgram.set(eyeLocation, eye);
+
+        glDispatchCompute(TILE_COUNT, TILE_COUNT, 1);
+
+        // The draws read the counts and the instance list written above
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
         renderProgram.use();
-        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &mvp[0][0]);
+        renderProgram.set(mvpLocation, mvp);
 
         glBindVertexArray(grassVao);
-        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 6, 1024 * 1024);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.name());
+        glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP, nullptr, LOD_COUNT, 0);
         glBindVertexArray(0);
 
-        glfwSwapBuffers(window);
+        context.swapBuffers();
     }
 
     return 0;
@@ -116,3 +200,89 @@ void error_cb(GLint error, const GLchar* description)
 {
     std::cerr << "GLFW error " << error << ": " << description << "\n";
 }
+
+// Value noise: random values on coarse lattices, smoothly interpolated and
+// summed over two octaves so the field has patches and some detail
+std::vector<GLubyte> createField(GLuint layer)
+{
+    std::vector<GLfloat> values(FIELD_SIZE * FIELD_SIZE, 0.0f);
+
+    const GLsizei cells[]   = { 16, 64 };
+    const GLfloat weights[] = { 0.7f, 0.3f };
+
+    for(GLuint octave = 0; octave < 2; octave++)
+    {
+        GLsizei size = cells[octave];
+        std::vector<GLfloat> lattice(size * size);
+
+        for(GLsizei i = 0; i < size * size; i++)
+        {
+            lattice[i] = simgll::uniformFloat(
+                simgll::philox(FIELD_SEED, layer, octave * 4096 + i)[0]);
+        }
+
+        GLfloat scale = static_cast<GLfloat>(size) / FIELD_SIZE;
+
+        for(GLsizei y = 0; y < FIELD_SIZE; y++)
+        {
+            for(GLsizei x = 0; x < FIELD_SIZE; x++)
+            {
+                GLfloat fx = x * scale, fy = y * scale;
+                GLsizei x0 = static_cast<GLsizei>(fx), y0 = static_cast<GLsizei>(fy);
+                GLsizei x1 = (x0 + 1) % size,          y1 = (y0 + 1) % size;
+
+                // Smoothstep weights hide the lattice
+                GLfloat tx = fx - x0, ty = fy - y0;
+                tx = tx * tx * (3.0f - 2.0f * tx);
+                ty = ty * ty * (3.0f - 2.0f * ty);
+
+                GLfloat top    = lattice[y0 * size + x0] * (1.0f - tx) +
+                                 lattice[y0 * size + x1] * tx;
+                GLfloat bottom = lattice[y1 * size + x0] * (1.0f - tx) +
+                                 lattice[y1 * size + x1] * tx;
+
+                values[y * FIELD_SIZE + x] += weights[octave] *
+                                              (top * (1.0f - ty) + bottom * ty);
+            }
+        }
+    }
+
+    std::vector<GLubyte> field(values.size());
+
+    for(std::size_t i = 0; i < values.size(); i++)
+    {
+        field[i] = static_cast<GLubyte>(std::min(values[i], 1.0f) * 255.0f);
+    }
+
+    return field;
+}
+
+// Dark green through lush green to dry straw
+std::vector<GLubyte> createPalette()
+{
+    const GLfloat stops[3][3] =
+    {
+        { 0.05f, 0.20f, 0.03f },
+        { 0.15f, 0.45f, 0.08f },
+        { 0.55f, 0.55f, 0.20f }
+    };
+
+    std::vector<GLubyte> palette(PALETTE_SIZE * 4);
+
+    for(GLsizei i = 0; i < PALETTE_SIZE; i++)
+    {
+        GLfloat t     = 2.0f * i / (PALETTE_SIZE - 1);
+        GLuint  first = std::min(static_cast<GLuint>(t), 1u);
+        GLfloat f     = t - first;
+
+        for(GLuint c = 0; c < 3; c++)
+        {
+            GLfloat value = stops[first][c] * (1.0f - f) + stops[first + 1][c] * f;
+            palette[i * 4 + c] = static_cast<GLubyte>(value * 255.0f);
+        }
+
+        palette[i * 4 + 3] = 255;
+    }
+
+    return palette;
+}
@@ -1,15 +1,29 @@
 #version 450 core
 
-in vec4 vVertex;
+layout (location = 0) in vec4 vVertex;
+
+// Visible blade written by cull.glsl, x index in the high bits and z index
+// in the low 10 bits
+layout (location = 1) in uint instance;
+
 out vec4 color;
 
 uniform mat4 mvp;
 
-layout (binding = 0) uniform sampler1D grasspalette_texture;
-layout (binding = 1) uniform sampler2D length_texture;
-layout (binding = 2) uniform sampler2D orientation_texture;
-layout (binding = 3) uniform sampler2D grasscolor_texture;
-layout (binding = 4) uniform sampler2D bend_texture;
+// Layers of the field texture array, in the order main.cpp fills them
+const float LENGTH_LAYER      = 0.0;
+const float ORIENTATION_LAYER = 1.0;
+const float COLOR_LAYER       = 2.0;
+const float BEND_LAYER        = 3.0;
+
+#ifdef SIMGLL_BINDLESS
+// Handles set once by the application, nothing is bound to texture units
+layout (bindless_sampler) uniform sampler2DArray fields;
+layout (bindless_sampler) uniform sampler2DArray palette;
+#else
+layout (binding = 0) uniform sampler2DArray fields;
+layout (binding = 1) uniform sampler2DArray palette;
+#endif
 
 int random(int seed, int iterations)
 {
@@ -26,7 +40,7 @@ int random(int seed, int iterations)
 
 vec4 random_vector(int seed)
 {
-    int r = random(gl_InstanceID, 4);
+    int r = random(seed, 4);
     int g = random(r, 2);
     int b = random(g, 2);
     int a = random(b, 2);
@@ -50,11 +64,13 @@ mat4 construct_rotation_matrix(float angle)
 
 void main(void)
 {
-    vec4 offset = vec4(float(gl_InstanceID >> 10) - 512.0,
+    int blade = int(instance);
+
+    vec4 offset = vec4(float(blade >> 10) - 512.0,
                        0.0f,
-                       float(gl_InstanceID & 0x3FF) - 512.0,
+                       float(blade & 0x3FF) - 512.0,
                        0.0f);
-    int number1 = random(gl_InstanceID, 3);
+    int number1 = random(blade, 3);
     int number2 = random(number1, 2);
     offset += vec4(float(number1 & 0xFF) / 256.0,
                    0.0f,
@@ -65,18 +81,19 @@ void main(void)
     vec2 texcoord = offset.xz / 1024.0 + vec2(0.5);
 
     // float bend_factor = float(random(number2, 7) & 0x3FF) / 1024.0;
-    float bend_factor = texture(bend_texture, texcoord).r * 2.0;
+    float bend_factor = texture(fields, vec3(texcoord, BEND_LAYER)).r * 2.0;
     float bend_amount = cos(vVertex.y);
 
-    float angle = texture(orientation_texture, texcoord).r * 2.0 * 3.141592;
+    float angle = texture(fields, vec3(texcoord, ORIENTATION_LAYER)).r * 2.0 * 3.141592;
     mat4 rot = construct_rotation_matrix(angle);
     vec4 position = (rot * (vVertex + vec4(0.0, 0.0, bend_amount * bend_factor, 0.0))) + offset;
 
-    position *= vec4(1.0, texture(length_texture, texcoord).r * 0.9 + 0.3, 1.0, 1.0);
+    position *= vec4(1.0, texture(fields, vec3(texcoord, LENGTH_LAYER)).r * 0.9 + 0.3, 1.0, 1.0);
 
     gl_Position = mvp * position; // (rot * position);
-    // color = vec4(random_vector(gl_InstanceID).xyz * vec3(0.1, 0.5, 0.1) + vec3(0.1, 0.4, 0.1), 1.0);
-    // color = texture(orientation_texture, texcoord);
-    color = texture(grasspalette_texture, texture(grasscolor_texture, texcoord).r) +
-        vec4(random_vector(gl_InstanceID).xyz * vec3(0.1, 0.5, 0.1), 1.0);
+    // color = vec4(random_vector(blade).xyz * vec3(0.1, 0.5, 0.1) + vec3(0.1, 0.4, 0.1), 1.0);
+    // color = texture(fields, vec3(texcoord, ORIENTATION_LAYER));
+    float shade = texture(fields, vec3(texcoord, COLOR_LAYER)).r;
+    color = texture(palette, vec3(shade, 0.5, 0.0)) +
+        vec4(random_vector(blade).xyz * vec3(0.1, 0.5, 0.1), 1.0);
 }
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
+
+#include "simgll_export.h"
+
+namespace simgll
+{
+    // Read-only archive of named blobs, mapped in memory once so shaders
+    // and textures are handed to GL straight from the mapping. Blobs start
+    // on 4 KiB boundaries, images are stored as KTX files already in the
+    // layout they are uploaded in (see the simgll-pack tool).
+    //
+    // The file is little endian: a 16 byte header ("SGPK", version, number
+    // of assets, size of the name table), one { offset, size, name offset,
+    // name size } entry of 64, 64, 32 and 32 bits per asset, the name table
+    // and the blobs.
+    class SIMGLL_EXPORT AssetPack
+    {
+    public:
+        struct Asset
+        {
+            std::string          name;
+            std::vector<GLubyte> data;
+        };
+
+        AssetPack();
+        ~AssetPack();
+
+        AssetPack(const AssetPack&)            = delete;
+        AssetPack& operator=(const AssetPack&) = delete;
+
+        // Maps the file, on failure the reason is in error
+        GLboolean open(const std::string& filename, std::string& error);
+        GLvoid close();
+
+        // Blob of an asset, nullptr if the pack doesn't have it. The memory
+        // stays valid until the pack is closed.
+        const GLubyte* find(const std::string& name, GLsizeiptr& size) const;
+
+        // Asks the system to start reading the blob in the background, so
+        // the first access doesn't stall on the file system
+        GLvoid prefetch(const std::string& name) const;
+
+        std::vector<std::string> names() const;
+
+        static GLboolean write(const std::string& filename,
+                               const std::vector<Asset>& assets,
+                               std::string& error);
+
+    private:
+        struct Blob
+        {
+            GLsizeiptr offset;
+            GLsizeiptr size;
+        };
+
+        const GLubyte* mData    = { nullptr };
+        GLsizeiptr     mSize    = { 0 };
+        GLvoid*        mFile    = { nullptr }; // Windows handles
+        GLvoid*        mMapping = { nullptr };
+        std::unordered_map<std::string, Blob> mAssets;
+    };
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <GL/glew.h>
+
+#include "simgll_export.h"
+
+namespace simgll
+{
+    // Immutable buffer object holding count elements of type T. When flags
+    // contain GL_MAP_PERSISTENT_BIT the whole store is mapped once at
+    // creation and stays mapped for the lifetime of the buffer.
+    template <typename T>
+    class Buffer
+    {
+    public:
+        // Empty buffer, useful as a placeholder that is assigned later
+        Buffer()
+        {
+        }
+
+        Buffer(GLsizeiptr count, GLbitfield flags = 0,
+               const T* data = nullptr) :
+            mCount(count),
+            mFlags(flags)
+        {
+            glGenBuffers(1, &mName);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mName);
+            glBufferStorage(GL_COPY_WRITE_BUFFER, bytes(), data, mFlags);
+
+            if(mFlags & GL_MAP_PERSISTENT_BIT)
+            {
+                mData = static_cast<T*>(glMapBufferRange(
+                    GL_COPY_WRITE_BUFFER, 0, bytes(),
+                    mFlags & (GL_MAP_READ_BIT | GL_MAP_WRITE_BIT |
+                              GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)));
+            }
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        ~Buffer()
+        {
+            // Deleting a buffer also unmaps it
+            glDeleteBuffers(1, &mName);
+        }
+
+        Buffer(const Buffer&)            = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        Buffer(Buffer&& other) :
+            mName(other.mName),
+            mCount(other.mCount),
+            mFlags(other.mFlags),
+            mData(other.mData)
+        {
+            other.mName = 0;
+            other.mData = nullptr;
+        }
+
+        Buffer& operator=(Buffer&& other)
+        {
+            std::swap(mName,  other.mName);
+            std::swap(mCount, other.mCount);
+            std::swap(mFlags, other.mFlags);
+            std::swap(mData,  other.mData);
+
+            return *this;
+        }
+
+        GLuint name() const
+        {
+            return mName;
+        }
+
+        GLsizeiptr size() const
+        {
+            return mCount;
+        }
+
+        GLsizeiptr bytes() const
+        {
+            return mCount * static_cast<GLsizeiptr>(sizeof(T));
+        }
+
+        // Persistently mapped pointer, nullptr for unmapped buffers
+        T* data() const
+        {
+            return mData;
+        }
+
+        GLvoid bindBase(GLenum target, GLuint index) const
+        {
+            glBindBufferBase(target, index, mName);
+        }
+
+        GLvoid bindRange(GLenum target, GLuint index, GLintptr first,
+                         GLsizeiptr count) const
+        {
+            glBindBufferRange(target, index, mName, first * sizeof(T),
+                              count * sizeof(T));
+        }
+
+        // Requires GL_DYNAMIC_STORAGE_BIT
+        GLvoid upload(const T* data, GLsizeiptr count, GLintptr first = 0)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mName);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof(T),
+                            count * sizeof(T), data);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        // Sets every byte of the buffer to zero
+        GLvoid clear()
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mName);
+            glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R8, GL_RED,
+                              GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        // Maps a range of a buffer that isn't persistently mapped
+        T* map(GLintptr first, GLsizeiptr count, GLbitfield access)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mName);
+
+            return static_cast<T*>(glMapBufferRange(GL_COPY_WRITE_BUFFER,
+                                                    first * sizeof(T),
+                                                    count * sizeof(T),
+                                                    access));
+        }
+
+        GLvoid unmap()
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mName);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+    private:
+        GLuint     mName  = { 0 };
+        GLsizeiptr mCount = { 0 };
+        GLbitfield mFlags = { 0 };
+        T*         mData  = { nullptr };
+    };
+
+    // Persistently and coherently mapped buffer split in regions (three by
+    // default) used round robin for per-frame uploads. begin() returns the
+    // next region, waiting on its fence only if the GPU is still reading it,
+    // end() fences the region after the commands that use it were issued.
+    class SIMGLL_EXPORT RingBuffer
+    {
+    public:
+        RingBuffer(GLsizeiptr regionSize, GLuint regions = 3);
+        ~RingBuffer();
+
+        RingBuffer(const RingBuffer&)            = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+
+        GLuint name() const;
+        GLsizeiptr regionSize() const;
+        GLintptr offset() const;
+
+        GLvoid* begin();
+        GLvoid end();
+
+        template <typename T>
+        T* begin()
+        {
+            return static_cast<T*>(begin());
+        }
+
+        // Binds the current region
+        GLvoid bindRange(GLenum target, GLuint index) const;
+
+    private:
+        GLuint     mName       = { 0 };
+        GLsizeiptr mRegionSize = { 0 };
+        GLuint     mRegions    = { 0 };
+        GLuint     mCurrent    = { 0 };
+        GLubyte*   mData       = { nullptr };
+        std::vector<GLsync> mFences;
+    };
+}
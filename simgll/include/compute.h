@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+
+#include "buffer.h"
+#include "shaderprogram.h"
+#include "simgll_export.h"
+
+namespace simgll
+{
+namespace compute
+{
+    // Element type of the buffers processed by a primitive, all of them are
+    // tightly packed 32-bit values
+    enum class Type
+    {
+        Int,
+        Uint,
+        Float
+    };
+
+    enum class Op
+    {
+        Sum,
+        Min,
+        Max
+    };
+
+    // Prefix sum over count elements of an arbitrary length buffer. Tiles of
+    // 1024 elements are scanned by one workgroup each, the tile totals are
+    // scanned recursively and added back to the tiles. input and output may
+    // be the same buffer.
+    class SIMGLL_EXPORT Scan
+    {
+    public:
+        Scan(Type type, GLboolean inclusive = GL_TRUE);
+
+        GLvoid run(GLuint input, GLuint output, GLuint count);
+
+    private:
+        GLvoid scanLevel(ShaderProgram& program, GLuint input, GLuint output,
+                         GLuint count, GLuint level);
+
+        ShaderProgram mScanProgram;
+        ShaderProgram mInclusiveProgram;
+        ShaderProgram mAddProgram;
+        GLboolean mInclusive;
+        std::vector<Buffer<GLuint>> mTileSums;
+    };
+
+    // Reduces count elements to a single one, written to result at
+    // resultOffset (in bytes)
+    class SIMGLL_EXPORT Reduce
+    {
+    public:
+        Reduce(Type type, Op op);
+
+        GLvoid run(GLuint input, GLuint count, GLuint result,
+                   GLintptr resultOffset = 0);
+
+    private:
+        ShaderProgram mProgram;
+        Buffer<GLuint> mPartials[2];
+    };
+
+    // Finds the minimum or maximum element and its index. The result is
+    // written as the std430 struct { T value; uint index; } (8 bytes), ties
+    // resolve to the lowest index. With segments > 1 the input is split in
+    // that many equally sized segments (count must be a multiple of it) and
+    // one result per segment is written, indices stay relative to the whole
+    // buffer.
+    class SIMGLL_EXPORT ArgReduce
+    {
+    public:
+        ArgReduce(Type type, Op op);
+
+        GLvoid run(GLuint input, GLuint count, GLuint result,
+                   GLintptr resultOffset = 0, GLuint segments = 1);
+
+    private:
+        ShaderProgram mFirstProgram;
+        ShaderProgram mProgram;
+        Buffer<GLuint> mPartials[2];
+    };
+
+    // Copies the elements whose flag is 1 to the front of output keeping
+    // their order. Flags are uints that must be 0 or 1. The number of
+    // elements kept is written as a uint to countBuffer at countOffset (in
+    // bytes) so it can feed indirect dispatches and draws.
+    class SIMGLL_EXPORT Compact
+    {
+    public:
+        Compact(Type type);
+
+        GLvoid run(GLuint input, GLuint flags, GLuint output, GLuint count,
+                   GLuint countBuffer, GLintptr countOffset = 0);
+
+    private:
+        Scan mScan;
+        ShaderProgram mScatterProgram;
+        Buffer<GLuint> mIndices;
+        Buffer<GLuint> mCount;
+    };
+
+    // Stable LSD radix sort with 4-bit digits. Keys are sorted in place, in
+    // ascending order (floats in IEEE total order with -0 before +0), an
+    // optional buffer of uint values is permuted along with them.
+    class SIMGLL_EXPORT RadixSort
+    {
+    public:
+        RadixSort(Type type, GLboolean withValues = GL_FALSE);
+
+        GLvoid run(GLuint keys, GLuint count, GLuint values = 0);
+
+    private:
+        Scan mScan;
+        ShaderProgram mHistogramProgram;
+        ShaderProgram mScatterProgram;
+        GLboolean mWithValues;
+        Buffer<GLuint> mHistogram;
+        Buffer<GLuint> mKeys;
+        Buffer<GLuint> mValues;
+    };
+}
+}
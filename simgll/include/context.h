@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <GL/glew.h>
+
+#include "simgll_export.h"
+
+struct GLFWwindow;
+
+namespace simgll
+{
+    // Owns the OpenGL context of an application. A Window context creates a
+    // GLFW window, a Headless context creates an EGL context without a
+    // surface (or with a small pbuffer when surfaceless contexts are not
+    // supported) so compute workloads can run on machines without a display.
+    class SIMGLL_EXPORT Context
+    {
+    public:
+        enum class Type
+        {
+            Window,
+            Headless
+        };
+
+        Context(Type type, GLuint width, GLuint height,
+                const std::string& title = "OpenGL App",
+                GLint major = 4, GLint minor = 3);
+        ~Context();
+
+        Context(const Context&)            = delete;
+        Context& operator=(const Context&) = delete;
+
+        Type type() const;
+        GLFWwindow* window() const;
+
+        GLboolean shouldClose() const;
+        GLvoid setShouldClose(GLboolean value);
+
+        GLvoid pollEvents();
+        GLvoid swapBuffers();
+
+    private:
+        GLvoid createWindow(GLuint width, GLuint height,
+                            const std::string& title, GLint major,
+                            GLint minor);
+        GLvoid createHeadless(GLuint width, GLuint height, GLint major,
+                              GLint minor);
+        GLvoid initGlew();
+
+        Type        mType;
+        GLFWwindow* mWindow      = { nullptr };
+        GLboolean   mShouldClose = { GL_FALSE };
+
+        // EGL handles are kept opaque so users don't need the EGL headers
+        void*       mEglDisplay  = { nullptr };
+        void*       mEglSurface  = { nullptr };
+        void*       mEglContext  = { nullptr };
+    };
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <GL/glew.h>
+
+#include "objective.h"
+#include "simgll_export.h"
+
+namespace simgll
+{
+namespace cpu
+{
+    // Host implementations of the compute examples, used as references for
+    // the GPU results and as a baseline to compare them with. Loops are split
+    // over ThreadPool::global() and vectorized with SSE2, or AVX when the
+    // library is built with it (see SIMGLL_NATIVE_ARCH), falling back to
+    // scalar code on other architectures.
+
+    enum class Op
+    {
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Min,
+        Max
+    };
+
+    // Prefix sum of count elements, input and output may be the same array.
+    // Float sums are associated per chunk, so they can differ in the last
+    // bits from a sequential sum unless every partial sum is exact.
+    SIMGLL_EXPORT GLvoid scan(const GLfloat* input, GLfloat* output,
+                              std::size_t count, GLboolean inclusive = GL_TRUE);
+    SIMGLL_EXPORT GLvoid scan(const GLuint* input, GLuint* output,
+                              std::size_t count, GLboolean inclusive = GL_TRUE);
+
+    // output[i] = a[i] op b[i], output may alias a or b
+    SIMGLL_EXPORT GLvoid elementWise(Op op, const GLfloat* a, const GLfloat* b,
+                                     GLfloat* output, std::size_t count);
+
+    // std430 layout of the Particle struct of the PSO examples
+    struct Particle
+    {
+        GLfloat position[3];
+        GLfloat pad0;
+        GLfloat velocity[3];
+        GLfloat pad1;
+        GLfloat bestPosition[3];
+        GLfloat fitness;
+    };
+
+    struct GlobalBest
+    {
+        GLfloat position[3];
+        GLfloat fitness;
+    };
+
+    // One iteration of PSO/pso.glsl, with the same philox() draws for the
+    // same seed and counter, so both give the same swarm up to floating point
+    // contraction. dimensions is 2 or 3, the coordinates passed to the
+    // objective.
+    SIMGLL_EXPORT GLvoid psoUpdate(const Objective& objective, GLuint dimensions,
+                                   const Particle* input, Particle* output,
+                                   std::size_t count, const GlobalBest& best,
+                                   GLfloat omega, GLuint seed, GLuint counter);
+
+    // std430 layout of the flock_member struct of SBFlocking
+    struct FlockMember
+    {
+        GLfloat position[3];
+        GLfloat pad0;
+        GLfloat velocity[3];
+        GLfloat pad1;
+    };
+
+    // Uniforms of SBFlocking/flocking_cs.glsl with the same defaults
+    struct FlockParameters
+    {
+        GLfloat closestAllowedDist = { 50.0f };
+        GLfloat rule1Weight        = { 0.18f };
+        GLfloat rule2Weight        = { 0.05f };
+        GLfloat rule3Weight        = { 0.17f };
+        GLfloat rule4Weight        = { 0.02f };
+        GLfloat goal[3]            = { 0.0f, 0.0f, 0.0f };
+        GLfloat timestep           = { 0.4f };
+    };
+
+    // One step of SBFlocking, neighbors are found with the same hashed grid
+    // of sqrt(closestAllowedDist) cells and tableSize (a power of two) slots
+    SIMGLL_EXPORT GLvoid flockUpdate(const FlockMember* input,
+                                     FlockMember* output, std::size_t count,
+                                     const FlockParameters& parameters,
+                                     GLuint tableSize);
+
+    // One step of ParticleSystem/compute_shader.glsl over count vec4
+    // positions (w = remaining life) and velocities, updated in place.
+    // attractors holds attractorCount vec4 (xyz = position, w = mass).
+    // Expired particles keep w <= 0, recycling them is up to the caller.
+    SIMGLL_EXPORT GLvoid particleUpdate(GLfloat* positions, GLfloat* velocities,
+                                        std::size_t count,
+                                        const GLfloat* attractors,
+                                        std::size_t attractorCount, GLfloat dt);
+
+    // Number of values farther than tolerance * max(1, |expected|) from the
+    // expected ones, to check a GPU result against the functions above.
+    // count records of components floats are compared, the strides are in
+    // floats so either side can be a field of larger records.
+    SIMGLL_EXPORT std::size_t countMismatches(const GLfloat* actual,
+                                              std::size_t actualStride,
+                                              const GLfloat* expected,
+                                              std::size_t expectedStride,
+                                              std::size_t count,
+                                              std::size_t components,
+                                              GLfloat tolerance);
+}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+#include "simgll_export.h"
+
+namespace simgll
+{
+    // Benchmark function for optimizers, written once as GLSL to be injected
+    // into a compute shader and once in C++ to validate the GPU results
+    struct SIMGLL_EXPORT Objective
+    {
+        std::string name;
+
+        // Required number of dimensions, 0 if any number works
+        GLuint dimensions;
+
+        // Search domain, the same for every coordinate, and the value of the
+        // global minimum
+        GLfloat lower;
+        GLfloat upper;
+        GLfloat minimum;
+
+        // Body of float objective(float x[DIM])
+        std::string body;
+
+        std::function<GLfloat(const GLfloat* x, GLuint n)> evaluate;
+
+        // Defines DIM, LOWER and UPPER and the objective() function for n
+        // dimensions, to be passed as the header of ShaderProgram::addShader
+        std::string glsl(GLuint n) const;
+    };
+
+    // The registry starts with sphere, rastrigin, rosenbrock, ackley,
+    // griewank, schwefel and goldsteinPrice (2D). Unknown names are a fatal
+    // error listing the available ones.
+    SIMGLL_EXPORT GLvoid registerObjective(const Objective& objective);
+    SIMGLL_EXPORT const Objective& findObjective(const std::string& name);
+    SIMGLL_EXPORT std::vector<std::string> objectiveNames();
+}
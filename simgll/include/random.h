@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <GL/glew.h>
+
+#include "simgll_export.h"
+
+namespace simgll
+{
+    // Counter-based random numbers (Philox4x32-10). Every (seed, stream,
+    // counter) triple gives four independent 32-bit words and there is no
+    // state to carry, so every thread or shader invocation draws its own
+    // numbers, typically with the element index as the stream and the
+    // iteration as the counter. philoxGlsl() defines the same functions for
+    // shaders, the words and the floats made from them are bit-exact on both
+    // sides.
+    SIMGLL_EXPORT std::array<GLuint, 4> philox(GLuint seed, GLuint stream,
+                                               GLuint counter);
+
+    // Float in [0, 1) from the top 24 bits of a word, exact in C++ and GLSL
+    inline GLfloat uniformFloat(GLuint bits)
+    {
+        return static_cast<GLfloat>(bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // Defines uvec4 philox(uint seed, uint stream, uint counter) and
+    // uniform_float() for uint and uvec4, to be passed as (part of) the
+    // header of ShaderProgram::addShader
+    SIMGLL_EXPORT std::string philoxGlsl();
+}
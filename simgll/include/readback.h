@@ -0,0 +1,74 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <GL/glew.h>
+
+#include "simgll_export.h"
+
+namespace simgll
+{
+    // Copies GPU results into a persistently mapped staging buffer and
+    // hands them to a callback once their fence has signaled, typically a
+    // few frames later, so reading results back never stalls the pipeline.
+    // Up to depth readbacks of at most capacity bytes can be in flight, when
+    // all slots are busy enqueue() waits for the oldest one. Callbacks read
+    // the staging buffer in place, data is only valid until they return, and
+    // they may enqueue again.
+    class SIMGLL_EXPORT ReadbackQueue
+    {
+    public:
+        typedef std::function<GLvoid(const GLvoid* data, GLsizeiptr size)>
+            Callback;
+
+        ReadbackQueue(GLsizeiptr capacity, GLuint depth = 3);
+        ~ReadbackQueue();
+
+        ReadbackQueue(const ReadbackQueue&)            = delete;
+        ReadbackQueue& operator=(const ReadbackQueue&) = delete;
+
+        // Reads size bytes of a buffer object starting at offset
+        GLvoid enqueue(GLuint buffer, GLintptr offset, GLsizeiptr size,
+                       Callback callback);
+
+        // Reads a whole texture level through the pixel pack buffer, size
+        // must match the format, type and dimensions of the level
+        GLvoid enqueueImage(GLenum target, GLuint texture, GLint level,
+                            GLenum format, GLenum type, GLsizeiptr size,
+                            Callback callback);
+
+        // Delivers every completed readback without blocking and returns
+        // how many were delivered
+        GLuint poll();
+
+        // Blocks until every pending readback has been delivered
+        GLvoid flush();
+
+        GLuint pending() const;
+
+    private:
+        struct Slot
+        {
+            GLsync     fence;
+            GLsizeiptr size;
+            Callback   callback;
+        };
+
+        GLuint acquire();
+        GLvoid submit(GLuint slot, GLsizeiptr size, Callback callback);
+        GLvoid deliver(GLboolean wait);
+
+        GLuint     mName     = { 0 };
+        GLsizeiptr mCapacity = { 0 };
+        GLuint     mDepth    = { 0 };
+        GLuint     mHead     = { 0 };
+        GLuint     mCount    = { 0 };
+        GLubyte*   mData     = { nullptr };
+        std::vector<Slot> mSlots;
+
+        // Pending slots in submission order, a ring of mCount entries from
+        // mHead, and the slots neither pending nor held by a callback
+        std::vector<GLuint> mOrder;
+        std::vector<GLuint> mFree;
+    };
+}
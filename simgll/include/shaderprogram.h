@@ -1,9 +1,17 @@
 #pragma once
 
 #include <iostream>
+#include <string>
 #include <vector>
+#include <unordered_map>
 #include <GL/glew.h>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
 
+#include "assetpack.h"
 #include "simgll_export.h"
 
 namespace simgll
@@ -16,14 +24,109 @@ namespace simgll
 
         GLuint name() const;
 
-        GLvoid addShader(const std::string& filename, const GLenum& shaderType);
+        // header is inserted right after the #version directive, it is meant
+        // for #defines and functions generated at runtime
+        GLvoid addShader(const std::string& filename, const GLenum& shaderType,
+                         const std::string& header = "");
+        GLvoid addShaderSource(const std::string& source,
+                               const GLenum& shaderType,
+                               const std::string& header = "");
+
+        // Source handed to the driver straight from the mapping of the pack,
+        // which must stay open until compile() or compileAsync()
+        GLvoid addShader(const AssetPack& pack, const std::string& name,
+                         const GLenum& shaderType,
+                         const std::string& header = "");
         GLvoid compile();
 
-        GLint getLocation(const std::string& name) const;
+        // Submits all stages and the link without waiting for the driver.
+        // Errors are reported by wait(), which getLocation() and use() call
+        // implicitly, so many programs can be compiled in parallel.
+        GLvoid compileAsync();
+        GLboolean ready() const;
+        GLvoid wait();
+
+        // Active uniforms and blocks are enumerated once after linking, so
+        // these are hash table lookups instead of driver queries
+        GLint getLocation(const std::string& name);
+        GLint getUniformBlockIndex(const std::string& name) const;
+        GLint getStorageBlockIndex(const std::string& name) const;
         GLvoid use();
 
+        // Uploads with glProgramUniform*(), values that are equal to the last
+        // one set through these functions are skipped
+        GLvoid set(GLint location, GLfloat value);
+        GLvoid set(GLint location, GLint value);
+        GLvoid set(GLint location, GLuint value);
+        GLvoid set(GLint location, const glm::vec2& value);
+        GLvoid set(GLint location, const glm::vec3& value);
+        GLvoid set(GLint location, const glm::vec4& value);
+        GLvoid set(GLint location, const glm::ivec2& value);
+        GLvoid set(GLint location, const glm::uvec2& value);
+        GLvoid set(GLint location, const glm::mat3& value);
+        GLvoid set(GLint location, const glm::mat4& value);
+
+        // Name lookups build a std::string and hash it on every call, they
+        // are meant for one-time setup. Code that runs every frame or every
+        // dispatch should keep the location from getLocation() instead.
+        template <typename T>
+        GLvoid set(const std::string& name, const T& value)
+        {
+            set(getLocation(name), value);
+        }
+
+        // Bindless texture handle (GL_ARB_bindless_texture) for a sampler
+        GLvoid setHandle(GLint location, GLuint64 handle);
+        GLvoid setHandle(const std::string& name, GLuint64 handle);
+
+        // Linked programs are stored in (and reloaded from) this directory
+        // with glGetProgramBinary/glProgramBinary. The directory must exist,
+        // an empty string disables the cache. It defaults to the value of the
+        // SIMGLL_SHADER_CACHE environment variable.
+        static GLvoid setCacheDirectory(const std::string& directory);
+
+        // Number of driver threads used by GL_KHR_parallel_shader_compile,
+        // the default lets the implementation choose
+        static GLvoid setCompilerThreads(GLuint count);
+
     private:
+        struct ShaderSource
+        {
+            GLenum      type;
+            std::string code;
+
+            // Source mapped from an asset pack, code then only holds the
+            // header, which goes after the first split characters
+            const GLchar* view     = { nullptr };
+            GLint         viewSize = { 0 };
+            GLint         split    = { 0 };
+
+            // The strings passed to glShaderSource, returns their count
+            GLsizei pieces(const GLchar* strings[3], GLint lengths[3]) const;
+        };
+
+        struct UniformValue
+        {
+            GLsizei size;
+            GLubyte data[sizeof(glm::mat4)];
+        };
+
+        GLvoid reflect();
+        GLboolean changed(GLint location, const GLvoid* data, GLsizei size);
+
+        std::string cacheKey() const;
+        GLboolean loadBinary(const std::string& path);
+        GLvoid saveBinary(const std::string& path) const;
+
         GLuint mProgramName = { 0 };
+        GLboolean mPending  = { GL_FALSE };
+        std::string mCachePath;
+        std::vector<ShaderSource> mSources;
         std::vector<GLuint> mShaderObjects;
+
+        std::unordered_map<std::string, GLint> mLocations;
+        std::unordered_map<std::string, GLint> mUniformBlocks;
+        std::unordered_map<std::string, GLint> mStorageBlocks;
+        std::vector<UniformValue> mValues;
     };
 }
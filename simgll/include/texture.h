@@ -1,11 +1,221 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <GL/glew.h>
 #include <FreeImage.h>
 
+#include "assetpack.h"
+#include "buffer.h"
 #include "simgll_export.h"
 
 namespace simgll
 {
+    // Pixels of every level stored in an image file, laid out the way GL
+    // reads them: rows of pixels, or rows of 4x4 blocks for compressed
+    // formats. Level offsets are relative to pixels, which points into data
+    // or into the memory the image was read from.
+    struct Image
+    {
+        struct Level
+        {
+            GLsizei    width;
+            GLsizei    height;
+            GLsizei    rows;
+            GLsizeiptr rowSize;
+            GLsizeiptr offset;
+        };
+
+        GLenum    internalFormat = { GL_RGBA8 };
+        GLenum    format         = { GL_BGRA };          // Unused if compressed
+        GLenum    type           = { GL_UNSIGNED_BYTE }; // Unused if compressed
+        GLint     alignment      = { 4 };                // Of the rows
+        GLboolean compressed     = { GL_FALSE };
+
+        // Single channel holding grey levels, sampled as (r, r, r, 1)
+        GLboolean luminance      = { GL_FALSE };
+
+        std::vector<Level>   levels;
+        std::vector<GLubyte> data;
+        const GLubyte*       pixels = { nullptr };
+    };
+
+    // Reads KTX (version 1) and DDS files as they are, with their mip chain
+    // in BC1 to BC7, ETC2/EAC or plain formats, and any other format known
+    // to FreeImage. FreeImage images keep 8-bit grey, 24 and 32-bit pixels,
+    // the rest is converted to 32 bits. Only 2D images are supported, on
+    // failure the reason is in error.
+    SIMGLL_EXPORT GLboolean readImage(const std::string& filename, Image& image,
+                                      std::string& error);
+
+    // Reads a KTX or DDS file already in memory without copying it, the
+    // memory must outlive the image. name only appears in errors.
+    SIMGLL_EXPORT GLboolean readImage(const GLubyte* data, GLsizeiptr size,
+                                      const std::string& name, Image& image,
+                                      std::string& error);
+
+    // KTX file holding the levels of the image, grey images keep their
+    // swizzle in the KTXswizzle key
+    SIMGLL_EXPORT std::vector<GLubyte> writeKtx(const Image& image);
+
+    // Immutable texture holding the levels of the image, images with a
+    // single uncompressed level get a generated mip chain. Returns 0 when
+    // the image can't be read, the reason is in error.
+    SIMGLL_EXPORT GLuint createTextureObject(const char* filename,
+                                             std::string& error);
+    SIMGLL_EXPORT GLuint createTextureObject(const AssetPack& pack,
+                                             const std::string& name,
+                                             std::string& error);
+
+    // Same as above but print the error and exit
     SIMGLL_EXPORT GLuint createTextureObject(const char* filename);
+    SIMGLL_EXPORT GLuint createTextureObject(const AssetPack& pack,
+                                             const std::string& name);
+
+    // Immutable GL_TEXTURE_2D_ARRAY, so related images of the same size and
+    // format share a single binding and are selected by layer in shaders.
+    // 0 levels allocates the full mip chain.
+    class SIMGLL_EXPORT TextureArray
+    {
+    public:
+        TextureArray(GLenum internalFormat, GLsizei width, GLsizei height,
+                     GLsizei layers, GLsizei levels = 1);
+        ~TextureArray();
+
+        TextureArray(const TextureArray&)            = delete;
+        TextureArray& operator=(const TextureArray&) = delete;
+
+        GLuint name() const;
+        GLsizei layers() const;
+
+        // Level 0 of a layer from tightly packed rows
+        GLvoid setLayer(GLint layer, GLenum format, GLenum type,
+                        const GLvoid* pixels);
+
+        // Every level of the image the array has, the image must have the
+        // size and internal format of the array
+        GLboolean setLayer(GLint layer, const Image& image, std::string& error);
+
+        GLvoid generateMipmaps();
+        GLvoid bind(GLuint unit) const;
+
+        // GL_ARB_bindless_texture handle, created and made resident by the
+        // first call. Shaders then sample the array without it being bound
+        // to a unit, but its layers can't be changed anymore.
+        GLuint64 handle();
+
+    private:
+        GLuint   mName           = { 0 };
+        GLenum   mInternalFormat = { GL_RGBA8 };
+        GLsizei  mWidth          = { 0 };
+        GLsizei  mHeight         = { 0 };
+        GLsizei  mLayers         = { 0 };
+        GLsizei  mLevels         = { 0 };
+        GLuint64 mHandle         = { 0 };
+    };
+
+    SIMGLL_EXPORT GLboolean bindlessSupported();
+
+    // Enables GL_ARB_bindless_texture and defines SIMGLL_BINDLESS when the
+    // driver supports it, empty otherwise. Meant to be passed as (part of)
+    // the header of ShaderProgram::addShader.
+    SIMGLL_EXPORT std::string bindlessGlsl();
+
+    // Loads 2D textures without stalling the frame. Worker threads read
+    // the images with readImage(), update() then copies the rows of every
+    // level into a persistently mapped pixel unpack buffer and uploads
+    // them, at most sliceSize bytes per call, so loading hundreds of
+    // textures is spread over frames. Compressed images are uploaded as
+    // they are. Textures that can't be loaded end up Failed with an error
+    // message instead of exiting.
+    //
+    // Everything but the decoding runs on the thread of the GL context.
+    // Resident textures belong to the caller and outlive the loader.
+    class SIMGLL_EXPORT TextureLoader
+    {
+    public:
+        enum class Status
+        {
+            Pending,
+            Resident,
+            Failed
+        };
+
+        // Stays valid for the lifetime of the loader
+        typedef GLuint Handle;
+
+        // 0 threads uses one decoding thread per hardware thread
+        explicit TextureLoader(GLuint threads = 0,
+                               GLsizeiptr sliceSize = 4 * 1024 * 1024);
+        ~TextureLoader();
+
+        TextureLoader(const TextureLoader&)            = delete;
+        TextureLoader& operator=(const TextureLoader&) = delete;
+
+        // Queues the file for decoding and returns immediately
+        Handle load(const std::string& filename);
+
+        // Same for a KTX or DDS image of a pack, which must stay open until
+        // the texture is resident
+        Handle load(const AssetPack& pack, const std::string& name);
+
+        // Uploads the next slice of decoded images, meant to be called
+        // once per frame. Returns how many textures became resident or
+        // failed during the call.
+        GLuint update();
+
+        // Blocks until every texture queued so far is resident or failed
+        GLvoid finish();
+
+        Status status(Handle handle) const;
+
+        // Texture object, 0 until the texture is resident
+        GLuint texture(Handle handle) const;
+
+        // Reason of the failure, empty unless the texture failed
+        const std::string& error(Handle handle) const;
+
+        // Textures neither resident nor failed yet
+        GLuint pending() const;
+
+    private:
+        struct Entry
+        {
+            std::string      filename;                 // Or name in pack
+            const AssetPack* pack    = { nullptr };
+            Status           status  = { Status::Pending };
+            std::string      error;
+            GLuint           texture = { 0 };
+
+            // Set by the decoding thread, released once uploaded
+            std::unique_ptr<Image> image;
+            GLuint                 level = { 0 };
+            GLuint                 row   = { 0 };
+        };
+
+        Handle queue(std::unique_ptr<Entry> entry);
+        GLvoid worker();
+        GLboolean nextUpload();
+        GLvoid complete(Entry& entry, Status status);
+
+        // Only the handles to decode and the decoded ones are shared with
+        // the workers, the rest of an entry belongs to the GL thread
+        std::vector<std::unique_ptr<Entry>> mEntries;
+        std::deque<Handle>                  mRequests;
+        std::deque<Handle>                  mDecoded;
+        std::vector<std::thread>            mThreads;
+        std::mutex                          mMutex;
+        std::condition_variable             mWake;
+        std::condition_variable             mReady;
+        GLboolean                           mStop = { GL_FALSE };
+
+        RingBuffer mStaging;
+        Entry*     mUpload  = { nullptr };
+        GLuint     mPending = { 0 };
+    };
 }
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+
+#include "simgll_export.h"
+
+namespace simgll
+{
+    // Worker threads for data parallel loops on the host. The calling thread
+    // takes part in the work, so a pool of one thread runs loops inline.
+    // Every thread owns a deque with a contiguous block of the chunks of a
+    // loop and runs them in order, a thread that runs out of chunks steals
+    // from the back of the others, so uneven chunks still balance.
+    class SIMGLL_EXPORT ThreadPool
+    {
+    public:
+        typedef std::function<GLvoid(std::size_t first, std::size_t last)>
+            Body;
+
+        // 0 uses one thread per hardware thread
+        explicit ThreadPool(GLuint threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&)            = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Number of threads running a loop, counting the caller
+        GLuint size() const;
+
+        // Splits [begin, end) in chunks of grain elements and calls
+        // body(first, last) once per chunk, returns when all of them are
+        // done. Loops started from inside a body run serially, loops started
+        // from several other threads run one after the other.
+        GLvoid parallelFor(std::size_t begin, std::size_t end,
+                           std::size_t grain, const Body& body);
+
+        // Pool shared by the library, created on first use
+        static ThreadPool& global();
+
+    private:
+        // Chunk indices of one thread, the owner takes them from the front
+        // and thieves from the back
+        struct Queue
+        {
+            std::mutex              mutex;
+            std::deque<std::size_t> chunks;
+        };
+
+        GLvoid worker(GLuint index);
+        GLvoid runChunks(GLuint index);
+        GLboolean takeChunk(GLuint index, std::size_t& chunk);
+
+        std::vector<std::thread>            mThreads;
+        std::vector<std::unique_ptr<Queue>> mQueues; // 0 is the caller's
+        std::mutex                          mLoopMutex;
+        std::mutex                          mMutex;
+        std::condition_variable             mWake;
+        std::condition_variable             mDone;
+
+        // Current loop, workers only join it while it is open
+        const Body* mBody       = { nullptr };
+        std::size_t mBegin      = { 0 };
+        std::size_t mEnd        = { 0 };
+        std::size_t mGrain      = { 1 };
+        GLuint      mGeneration = { 0 };
+        GLuint      mActive     = { 0 };
+        GLboolean   mOpen       = { GL_FALSE };
+        GLboolean   mStop       = { GL_FALSE };
+    };
+}
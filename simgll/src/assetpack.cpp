@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include "assetpack.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char       PACK_MAGIC[4]   = { 'S', 'G', 'P', 'K' };
+    const GLuint     PACK_VERSION    = 1;
+    const GLsizeiptr PACK_ALIGNMENT  = 4096;
+    const GLsizeiptr HEADER_SIZE     = 16;
+    const GLsizeiptr ENTRY_SIZE      = 24;
+
+    struct Entry
+    {
+        std::uint64_t offset;
+        std::uint64_t size;
+        std::uint32_t nameOffset;
+        std::uint32_t nameSize;
+    };
+
+    GLsizeiptr align(GLsizeiptr offset)
+    {
+        return (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+    }
+
+    template <typename T>
+    T read(const GLubyte* data, GLsizeiptr offset)
+    {
+        T value;
+        std::memcpy(&value, data + offset, sizeof(value));
+
+        return value;
+    }
+
+    template <typename T>
+    GLvoid writeValue(std::ofstream& file, T value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+}
+
+simgll::AssetPack::AssetPack()
+{
+}
+
+simgll::AssetPack::~AssetPack()
+{
+    close();
+}
+
+GLboolean simgll::AssetPack::open(const std::string& filename,
+                                  std::string& error)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    LARGE_INTEGER size;
+
+    if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+    {
+        error = "Can't open asset pack " + filename;
+
+        if(file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+
+        return GL_FALSE;
+    }
+
+    mFile    = file;
+    mSize    = static_cast<GLsizeiptr>(size.QuadPart);
+    mMapping = mSize > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0,
+                                              nullptr) : nullptr;
+    mData    = mMapping ? static_cast<const GLubyte*>(
+                   MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+    int file = ::open(filename.c_str(), O_RDONLY);
+    struct stat status;
+
+    if(file < 0 || fstat(file, &status) != 0)
+    {
+        error = "Can't open asset pack " + filename;
+
+        if(file >= 0)
+        {
+            ::close(file);
+        }
+
+        return GL_FALSE;
+    }
+
+    // The mapping keeps the file open
+    mSize = static_cast<GLsizeiptr>(status.st_size);
+
+    GLvoid* data = mSize > 0 ? mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE,
+                                    file, 0) : MAP_FAILED;
+    mData = data != MAP_FAILED ? static_cast<const GLubyte*>(data) : nullptr;
+
+    ::close(file);
+#endif
+
+    if(!mData)
+    {
+        error = "Can't map asset pack " + filename;
+        close();
+
+        return GL_FALSE;
+    }
+
+    GLuint     count     = mSize >= HEADER_SIZE ? read<GLuint>(mData, 8)  : 0;
+    GLsizeiptr namesSize = mSize >= HEADER_SIZE ? read<GLuint>(mData, 12) : 0;
+    GLsizeiptr nameTable = HEADER_SIZE + count * ENTRY_SIZE;
+
+    if(mSize < HEADER_SIZE || std::memcmp(mData, PACK_MAGIC, 4) != 0 ||
+       read<GLuint>(mData, 4) != PACK_VERSION || nameTable + namesSize > mSize)
+    {
+        error = filename + " isn't an asset pack";
+        close();
+
+        return GL_FALSE;
+    }
+
+    for(GLuint i = 0; i < count; i++)
+    {
+        GLsizeiptr position = HEADER_SIZE + i * ENTRY_SIZE;
+
+        Entry entry;
+        entry.offset     = read<std::uint64_t>(mData, position);
+        entry.size       = read<std::uint64_t>(mData, position + 8);
+        entry.nameOffset = read<std::uint32_t>(mData, position + 16);
+        entry.nameSize   = read<std::uint32_t>(mData, position + 20);
+
+        if(entry.offset > static_cast<std::uint64_t>(mSize) ||
+           entry.size > static_cast<std::uint64_t>(mSize) - entry.offset ||
+           entry.nameOffset + static_cast<GLsizeiptr>(entry.nameSize) > namesSize)
+        {
+            error = "Corrupted asset pack " + filename;
+            close();
+
+            return GL_FALSE;
+        }
+
+        std::string name(reinterpret_cast<const char*>(mData) + nameTable +
+                         entry.nameOffset, entry.nameSize);
+
+        mAssets[name] = { static_cast<GLsizeiptr>(entry.offset),
+                          static_cast<GLsizeiptr>(entry.size) };
+    }
+
+    return GL_TRUE;
+}
+
+GLvoid simgll::AssetPack::close()
+{
+#ifdef _WIN32
+    if(mData)
+    {
+        UnmapViewOfFile(mData);
+    }
+
+    if(mMapping)
+    {
+        CloseHandle(mMapping);
+    }
+
+    if(mFile)
+    {
+        CloseHandle(mFile);
+    }
+#else
+    if(mData)
+    {
+        munmap(const_cast<GLubyte*>(mData), mSize);
+    }
+#endif
+
+    mData    = nullptr;
+    mSize    = 0;
+    mFile    = nullptr;
+    mMapping = nullptr;
+    mAssets.clear();
+}
+
+const GLubyte* simgll::AssetPack::find(const std::string& name,
+                                       GLsizeiptr& size) const
+{
+    auto it = mAssets.find(name);
+
+    if(it == mAssets.end())
+    {
+        size = 0;
+
+        return nullptr;
+    }
+
+    size = it->second.size;
+
+    return mData + it->second.offset;
+}
+
+GLvoid simgll::AssetPack::prefetch(const std::string& name) const
+{
+#ifndef _WIN32
+    GLsizeiptr size;
+    const GLubyte* data = find(name, size);
+
+    // Blobs are only aligned to PACK_ALIGNMENT, pages may be larger
+    if(data && size > 0)
+    {
+        const std::uintptr_t page  = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+        const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(data) & ~(page - 1);
+        const std::uintptr_t end   = reinterpret_cast<std::uintptr_t>(data) + size;
+
+        posix_madvise(reinterpret_cast<GLvoid*>(start), end - start,
+                      POSIX_MADV_WILLNEED);
+    }
+#else
+    (GLvoid)name;
+#endif
+}
+
+std::vector<std::string> simgll::AssetPack::names() const
+{
+    std::vector<std::string> names;
+
+    for(const auto& asset : mAssets)
+    {
+        names.push_back(asset.first);
+    }
+
+    std::sort(names.begin(), names.end());
+
+    return names;
+}
+
+GLboolean simgll::AssetPack::write(const std::string& filename,
+                                   const std::vector<Asset>& assets,
+                                   std::string& error)
+{
+    std::string names;
+    std::vector<Entry> entries;
+
+    for(const Asset& asset : assets)
+    {
+        entries.push_back({ 0, asset.data.size(),
+                            static_cast<std::uint32_t>(names.size()),
+                            static_cast<std::uint32_t>(asset.name.size()) });
+        names += asset.name;
+    }
+
+    GLsizeiptr offset = align(HEADER_SIZE + entries.size() * ENTRY_SIZE +
+                              names.size());
+
+    for(Entry& entry : entries)
+    {
+        entry.offset = offset;
+        offset       = align(offset + entry.size);
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+
+    file.write(PACK_MAGIC, sizeof(PACK_MAGIC));
+    writeValue<std::uint32_t>(file, PACK_VERSION);
+    writeValue<std::uint32_t>(file, static_cast<std::uint32_t>(entries.size()));
+    writeValue<std::uint32_t>(file, static_cast<std::uint32_t>(names.size()));
+
+    for(const Entry& entry : entries)
+    {
+        writeValue(file, entry.offset);
+        writeValue(file, entry.size);
+        writeValue(file, entry.nameOffset);
+        writeValue(file, entry.nameSize);
+    }
+
+    file.write(names.data(), names.size());
+
+    for(std::size_t i = 0; i < assets.size(); i++)
+    {
+        // Zero padding up to the start of the blob
+        std::vector<char> padding(entries[i].offset -
+                                  static_cast<std::uint64_t>(file.tellp()), 0);
+        file.write(padding.data(), padding.size());
+
+        file.write(reinterpret_cast<const char*>(assets[i].data.data()),
+                   assets[i].data.size());
+    }
+
+    if(!file)
+    {
+        error = "Can't write asset pack " + filename;
+
+        return GL_FALSE;
+    }
+
+    return GL_TRUE;
+}
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include "buffer.h"
+
+simgll::RingBuffer::RingBuffer(GLsizeiptr regionSize, GLuint regions) :
+    mRegions(regions),
+    mFences(regions, nullptr)
+{
+    // Every region must be usable as the offset of a uniform or storage
+    // buffer binding
+    GLint uboAlignment, ssboAlignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssboAlignment);
+
+    GLsizeiptr alignment = std::max(uboAlignment, ssboAlignment);
+    mRegionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                             GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &mName);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mName);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, mRegionSize * mRegions, nullptr,
+                    flags);
+    mData = static_cast<GLubyte*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+                                                   mRegionSize * mRegions,
+                                                   flags));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // The first call to begin() moves to region 0
+    mCurrent = mRegions - 1;
+}
+
+simgll::RingBuffer::~RingBuffer()
+{
+    for(auto fence: mFences)
+    {
+        glDeleteSync(fence);
+    }
+
+    glDeleteBuffers(1, &mName);
+}
+
+GLuint simgll::RingBuffer::name() const
+{
+    return mName;
+}
+
+GLsizeiptr simgll::RingBuffer::regionSize() const
+{
+    return mRegionSize;
+}
+
+GLintptr simgll::RingBuffer::offset() const
+{
+    return mCurrent * mRegionSize;
+}
+
+GLvoid* simgll::RingBuffer::begin()
+{
+    mCurrent = (mCurrent + 1) % mRegions;
+
+    GLsync& fence = mFences[mCurrent];
+
+    // With enough regions the fence has long been signaled and this
+    // returns immediately
+    if(fence)
+    {
+        GLenum result;
+
+        do
+        {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                      1000000);
+        } while(result == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    return mData + offset();
+}
+
+GLvoid simgll::RingBuffer::end()
+{
+    mFences[mCurrent] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLvoid simgll::RingBuffer::bindRange(GLenum target, GLuint index) const
+{
+    glBindBufferRange(target, index, mName, offset(), mRegionSize);
+}
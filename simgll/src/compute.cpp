@@ -0,0 +1,856 @@
+#include <algorithm>
+#include <string>
+#include "compute.h"
+
+using simgll::compute::Type;
+using simgll::compute::Op;
+
+namespace
+{
+    const GLuint LOCAL_SIZE = 256;
+    const GLuint TILE_SIZE  = 1024;
+
+    // Explicit uniform locations of the kernels, run() sets them without
+    // looking their names up
+    const GLint NUM_GROUPS_LOCATION     = 0;
+    const GLint COUNT_LOCATION          = 1;
+    const GLint SEGMENT_GROUPS_LOCATION = 2;
+    const GLint SHIFT_LOCATION          = 2;
+
+    const char* COMMON_SOURCE = R"(
+#define LOCAL_SIZE 256
+#define ITEMS      4
+#define TILE_SIZE  (LOCAL_SIZE * ITEMS)
+
+layout (local_size_x = LOCAL_SIZE) in;
+
+// Dispatches with more than 65535 workgroups are split in two dimensions,
+// the extra workgroups of the last row exit right away
+layout (location = 0) uniform uint num_groups;
+
+uint group_id()
+{
+    return gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
+
+// Maps a float to a uint with the same ordering
+uint float_key(float k)
+{
+    uint u = floatBitsToUint(k);
+
+    return (u & 0x80000000u) != 0u ? ~u : (u | 0x80000000u);
+}
+)";
+
+    const char* SCAN_SOURCE = R"(
+layout (std430, binding = 0) readonly buffer input_block
+{
+    T input_data[];
+};
+
+layout (std430, binding = 1) writeonly buffer output_block
+{
+    T output_data[];
+};
+
+layout (std430, binding = 2) writeonly buffer sums_block
+{
+    T tile_sums[];
+};
+
+layout (location = 1) uniform uint count;
+
+shared T shared_data[LOCAL_SIZE];
+
+void main()
+{
+    uint group = group_id();
+
+    if (group >= num_groups)
+        return;
+
+    uint local_id = gl_LocalInvocationID.x;
+    uint base = group * TILE_SIZE + local_id * ITEMS;
+
+    // Each invocation sums ITEMS consecutive elements serially
+    T items[ITEMS];
+    T total = T(0);
+
+    for (uint i = 0; i < ITEMS; i++)
+    {
+        items[i] = base + i < count ? input_data[base + i] : T(0);
+        total += items[i];
+    }
+
+    shared_data[local_id] = total;
+    barrier();
+
+    // Hillis-Steele inclusive scan of the per invocation totals
+    for (uint offset = 1; offset < LOCAL_SIZE; offset <<= 1)
+    {
+        T value = local_id >= offset ? shared_data[local_id - offset] : T(0);
+        barrier();
+        shared_data[local_id] += value;
+        barrier();
+    }
+
+    T prefix = local_id > 0 ? shared_data[local_id - 1] : T(0);
+
+    for (uint i = 0; i < ITEMS; i++)
+    {
+#ifdef INCLUSIVE
+        prefix += items[i];
+#endif
+        if (base + i < count)
+            output_data[base + i] = prefix;
+#ifndef INCLUSIVE
+        prefix += items[i];
+#endif
+    }
+
+    if (local_id == LOCAL_SIZE - 1)
+        tile_sums[group] = shared_data[local_id];
+}
+)";
+
+    const char* ADD_SOURCE = R"(
+layout (std430, binding = 1) buffer output_block
+{
+    T output_data[];
+};
+
+// Inclusive scan of the tile totals
+layout (std430, binding = 2) readonly buffer sums_block
+{
+    T tile_sums[];
+};
+
+layout (location = 1) uniform uint count;
+
+void main()
+{
+    uint group = group_id();
+
+    if (group == 0 || group >= num_groups)
+        return;
+
+    T offset = tile_sums[group - 1];
+
+    for (uint i = 0; i < ITEMS; i++)
+    {
+        uint index = group * TILE_SIZE + i * LOCAL_SIZE + gl_LocalInvocationID.x;
+
+        if (index < count)
+            output_data[index] += offset;
+    }
+}
+)";
+
+    const char* REDUCE_SOURCE = R"(
+layout (std430, binding = 0) readonly buffer input_block
+{
+    T input_data[];
+};
+
+layout (std430, binding = 1) writeonly buffer output_block
+{
+    T output_data[];
+};
+
+layout (location = 1) uniform uint count;
+
+shared T shared_data[LOCAL_SIZE];
+
+void main()
+{
+    uint group = group_id();
+
+    if (group >= num_groups)
+        return;
+
+    uint local_id = gl_LocalInvocationID.x;
+    T value = IDENTITY;
+
+    for (uint i = 0; i < ITEMS; i++)
+    {
+        uint index = group * TILE_SIZE + i * LOCAL_SIZE + local_id;
+
+        if (index < count)
+            value = OP(value, input_data[index]);
+    }
+
+    shared_data[local_id] = value;
+    barrier();
+
+    for (uint stride = LOCAL_SIZE / 2; stride > 0; stride >>= 1)
+    {
+        if (local_id < stride)
+            shared_data[local_id] = OP(shared_data[local_id],
+                                       shared_data[local_id + stride]);
+        barrier();
+    }
+
+    if (local_id == 0)
+        output_data[group] = shared_data[0];
+}
+)";
+
+    const char* ARG_REDUCE_SOURCE = R"(
+struct Pair
+{
+    T value;
+    uint index;
+};
+
+#ifdef FIRST_PASS
+layout (std430, binding = 0) readonly buffer input_block
+{
+    T input_data[];
+};
+#else
+layout (std430, binding = 0) readonly buffer input_block
+{
+    Pair input_data[];
+};
+#endif
+
+layout (std430, binding = 1) writeonly buffer output_block
+{
+    Pair output_data[];
+};
+
+// Elements and workgroups per segment, the workgroups of a segment are
+// contiguous so the partial results of a pass are segmented the same way
+layout (location = 1) uniform uint count;
+layout (location = 2) uniform uint segment_groups;
+
+shared T shared_values[LOCAL_SIZE];
+shared uint shared_indices[LOCAL_SIZE];
+
+// Ties go to the lowest index so the result doesn't depend on scheduling
+bool better(T a_value, uint a_index, T b_value, uint b_index)
+{
+    return COMPARE(a_value, b_value) ||
+           (a_value == b_value && a_index < b_index);
+}
+
+void main()
+{
+    uint group = group_id();
+
+    if (group >= num_groups)
+        return;
+
+    uint local_id = gl_LocalInvocationID.x;
+    uint segment = group / segment_groups;
+    uint tile = group - segment * segment_groups;
+    T best_value = IDENTITY;
+    uint best_index = 0xffffffffu;
+
+    for (uint i = 0; i < ITEMS; i++)
+    {
+        uint index = tile * TILE_SIZE + i * LOCAL_SIZE + local_id;
+
+        if (index < count)
+        {
+            uint element = segment * count + index;
+#ifdef FIRST_PASS
+            T value = input_data[element];
+            uint value_index = element;
+#else
+            T value = input_data[element].value;
+            uint value_index = input_data[element].index;
+#endif
+            if (better(value, value_index, best_value, best_index))
+            {
+                best_value = value;
+                best_index = value_index;
+            }
+        }
+    }
+
+    shared_values[local_id] = best_value;
+    shared_indices[local_id] = best_index;
+    barrier();
+
+    for (uint stride = LOCAL_SIZE / 2; stride > 0; stride >>= 1)
+    {
+        if (local_id < stride &&
+            better(shared_values[local_id + stride],
+                   shared_indices[local_id + stride],
+                   shared_values[local_id], shared_indices[local_id]))
+        {
+            shared_values[local_id] = shared_values[local_id + stride];
+            shared_indices[local_id] = shared_indices[local_id + stride];
+        }
+        barrier();
+    }
+
+    if (local_id == 0)
+        output_data[group] = Pair(shared_values[0], shared_indices[0]);
+}
+)";
+
+    const char* COMPACT_SOURCE = R"(
+layout (std430, binding = 0) readonly buffer input_block
+{
+    T input_data[];
+};
+
+layout (std430, binding = 1) readonly buffer flags_block
+{
+    uint flags[];
+};
+
+// Exclusive scan of the flags
+layout (std430, binding = 2) readonly buffer indices_block
+{
+    uint indices[];
+};
+
+layout (std430, binding = 3) writeonly buffer output_block
+{
+    T output_data[];
+};
+
+layout (std430, binding = 4) writeonly buffer count_block
+{
+    uint kept;
+};
+
+layout (location = 1) uniform uint count;
+
+void main()
+{
+    uint group = group_id();
+
+    if (group >= num_groups)
+        return;
+
+    for (uint i = 0; i < ITEMS; i++)
+    {
+        uint index = group * TILE_SIZE + i * LOCAL_SIZE + gl_LocalInvocationID.x;
+
+        if (index < count && flags[index] != 0u)
+            output_data[indices[index]] = input_data[index];
+
+        if (index == count - 1)
+            kept = indices[index] + flags[index];
+    }
+}
+)";
+
+    const char* HISTOGRAM_SOURCE = R"(
+layout (std430, binding = 0) readonly buffer keys_block
+{
+    T keys[];
+};
+
+// Digit-major: the count of digit d in workgroup g is at d * num_groups + g
+layout (std430, binding = 1) writeonly buffer histogram_block
+{
+    uint histogram[];
+};
+
+layout (location = 1) uniform uint count;
+layout (location = 2) uniform uint shift;
+
+shared uint counts[16];
+
+void main()
+{
+    uint group = group_id();
+
+    if (group >= num_groups)
+        return;
+
+    uint local_id = gl_LocalInvocationID.x;
+    uint index = group * LOCAL_SIZE + local_id;
+
+    if (local_id < 16)
+        counts[local_id] = 0u;
+    barrier();
+
+    if (index < count)
+        atomicAdd(counts[(KEY_BITS(keys[index]) >> shift) & 0xFu], 1u);
+    barrier();
+
+    if (local_id < 16)
+        histogram[local_id * num_groups + group] = counts[local_id];
+}
+)";
+
+    const char* SCATTER_SOURCE = R"(
+layout (std430, binding = 0) readonly buffer keys_in_block
+{
+    T keys_in[];
+};
+
+layout (std430, binding = 1) writeonly buffer keys_out_block
+{
+    T keys_out[];
+};
+
+// Exclusive scan of the digit-major histogram
+layout (std430, binding = 2) readonly buffer offsets_block
+{
+    uint offsets[];
+};
+
+#ifdef WITH_VALUES
+layout (std430, binding = 3) readonly buffer values_in_block
+{
+    uint values_in[];
+};
+
+layout (std430, binding = 4) writeonly buffer values_out_block
+{
+    uint values_out[];
+};
+
+shared uint shared_values[LOCAL_SIZE];
+#endif
+
+layout (location = 1) uniform uint count;
+layout (location = 2) uniform uint shift;
+
+shared T shared_keys[LOCAL_SIZE];
+shared uint shared_digits[LOCAL_SIZE];
+shared uint shared_scan[LOCAL_SIZE];
+shared uint digit_start[16];
+
+void main()
+{
+    uint group = group_id();
+
+    if (group >= num_groups)
+        return;
+
+    uint local_id = gl_LocalInvocationID.x;
+    uint index = group * LOCAL_SIZE + local_id;
+    uint valid = min(count - group * LOCAL_SIZE, LOCAL_SIZE);
+
+    // Padding gets the largest digit so the stable local sort moves it
+    // behind every valid key
+    T key = T(0);
+    uint digit = 0xFu;
+
+    if (index < count)
+    {
+        key = keys_in[index];
+        digit = (KEY_BITS(key) >> shift) & 0xFu;
+    }
+
+#ifdef WITH_VALUES
+    uint value = index < count ? values_in[index] : 0u;
+#endif
+
+    // Sort the tile by digit with four stable 1-bit splits
+    for (uint bit = 0; bit < 4; bit++)
+    {
+        uint is_zero = ((digit >> bit) & 1u) == 0u ? 1u : 0u;
+
+        shared_scan[local_id] = is_zero;
+        barrier();
+
+        for (uint offset = 1; offset < LOCAL_SIZE; offset <<= 1)
+        {
+            uint v = local_id >= offset ? shared_scan[local_id - offset] : 0u;
+            barrier();
+            shared_scan[local_id] += v;
+            barrier();
+        }
+
+        uint zeros_before = shared_scan[local_id] - is_zero;
+        uint total_zeros = shared_scan[LOCAL_SIZE - 1];
+        uint position = is_zero != 0u ? zeros_before
+                                      : total_zeros + local_id - zeros_before;
+
+        shared_keys[position] = key;
+        shared_digits[position] = digit;
+#ifdef WITH_VALUES
+        shared_values[position] = value;
+#endif
+        barrier();
+
+        key = shared_keys[local_id];
+        digit = shared_digits[local_id];
+#ifdef WITH_VALUES
+        value = shared_values[local_id];
+#endif
+        barrier();
+    }
+
+    // First position of every digit in the sorted tile
+    if (local_id == 0 || shared_digits[local_id - 1] != digit)
+        digit_start[digit] = local_id;
+    barrier();
+
+    if (local_id < valid)
+    {
+        uint destination = offsets[digit * num_groups + group] +
+                           local_id - digit_start[digit];
+
+        keys_out[destination] = key;
+#ifdef WITH_VALUES
+        values_out[destination] = value;
+#endif
+    }
+}
+)";
+
+    std::string typeDefines(Type type)
+    {
+        switch(type)
+        {
+        case Type::Int:
+            return "#define T int\n"
+                   "#define T_MAX 2147483647\n"
+                   "#define T_LOWEST (-2147483647 - 1)\n"
+                   "#define KEY_BITS(k) (uint(k) ^ 0x80000000u)\n";
+        case Type::Uint:
+            return "#define T uint\n"
+                   "#define T_MAX 0xffffffffu\n"
+                   "#define T_LOWEST 0u\n"
+                   "#define KEY_BITS(k) (k)\n";
+        case Type::Float:
+        default:
+            return "#define T float\n"
+                   "#define T_MAX uintBitsToFloat(0x7f800000u)\n"
+                   "#define T_LOWEST uintBitsToFloat(0xff800000u)\n"
+                   "#define KEY_BITS(k) float_key(k)\n";
+        }
+    }
+
+    std::string opDefines(Op op)
+    {
+        switch(op)
+        {
+        case Op::Min:
+            return "#define OP(a, b) min(a, b)\n"
+                   "#define COMPARE(a, b) ((a) < (b))\n"
+                   "#define IDENTITY T_MAX\n";
+        case Op::Max:
+            return "#define OP(a, b) max(a, b)\n"
+                   "#define COMPARE(a, b) ((a) > (b))\n"
+                   "#define IDENTITY T_LOWEST\n";
+        case Op::Sum:
+        default:
+            return "#define OP(a, b) ((a) + (b))\n"
+                   "#define COMPARE(a, b) ((a) < (b))\n"
+                   "#define IDENTITY T(0)\n";
+        }
+    }
+
+    GLvoid build(simgll::ShaderProgram& program, Type type,
+                 const std::string& defines, const char* source)
+    {
+        program.addShaderSource("#version 430 core\n" + typeDefines(type) +
+                                defines + COMMON_SOURCE + source,
+                                GL_COMPUTE_SHADER);
+        program.compileAsync();
+    }
+
+    GLuint groupCount(GLuint count, GLuint groupSize)
+    {
+        return (count + groupSize - 1) / groupSize;
+    }
+
+    GLvoid dispatch(simgll::ShaderProgram& program, GLuint groups)
+    {
+        GLuint x = std::min(groups, 65535U);
+        GLuint y = groupCount(groups, x);
+
+        program.set(NUM_GROUPS_LOCATION, groups);
+        program.use();
+
+        glDispatchCompute(x, y, 1);
+    }
+
+    // Grows a scratch buffer so it holds at least count uints
+    GLvoid reserve(simgll::Buffer<GLuint>& buffer, GLsizeiptr count)
+    {
+        if(buffer.size() < count)
+        {
+            buffer = simgll::Buffer<GLuint>(std::max<GLsizeiptr>(count, 1));
+        }
+    }
+
+    GLvoid copyBytes(GLuint source, GLuint destination, GLintptr offset,
+                     GLsizeiptr size)
+    {
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                            offset, size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+simgll::compute::Scan::Scan(Type type, GLboolean inclusive) :
+    mInclusive(inclusive)
+{
+    build(mScanProgram, type, inclusive ? "#define INCLUSIVE\n" : "",
+          SCAN_SOURCE);
+
+    // The tile totals are always scanned inclusively
+    if(!inclusive)
+    {
+        build(mInclusiveProgram, type, "#define INCLUSIVE\n", SCAN_SOURCE);
+    }
+
+    build(mAddProgram, type, "", ADD_SOURCE);
+}
+
+GLvoid simgll::compute::Scan::run(GLuint input, GLuint output, GLuint count)
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    scanLevel(mScanProgram, input, output, count, 0);
+}
+
+GLvoid simgll::compute::Scan::scanLevel(ShaderProgram& program, GLuint input,
+                                        GLuint output, GLuint count,
+                                        GLuint level)
+{
+    GLuint tiles = groupCount(count, TILE_SIZE);
+
+    if(mTileSums.size() <= level)
+    {
+        mTileSums.resize(level + 1);
+    }
+
+    reserve(mTileSums[level], tiles);
+
+    // Keep the name, the recursion below may reallocate mTileSums
+    GLuint sums = mTileSums[level].name();
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, input);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, output);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, sums);
+
+    program.set(COUNT_LOCATION, count);
+    dispatch(program, tiles);
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if(tiles > 1)
+    {
+        scanLevel(mInclusive ? mScanProgram : mInclusiveProgram, sums, sums,
+                  tiles, level + 1);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, output);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, sums);
+
+        mAddProgram.set(COUNT_LOCATION, count);
+        dispatch(mAddProgram, tiles);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+}
+
+simgll::compute::Reduce::Reduce(Type type, Op op)
+{
+    build(mProgram, type, opDefines(op), REDUCE_SOURCE);
+}
+
+GLvoid simgll::compute::Reduce::run(GLuint input, GLuint count, GLuint result,
+                                    GLintptr resultOffset)
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    GLuint groups = groupCount(count, TILE_SIZE);
+    reserve(mPartials[0], groups);
+    reserve(mPartials[1], groups);
+
+    GLuint source = input;
+    GLuint pass   = 0;
+
+    do
+    {
+        groups = groupCount(count, TILE_SIZE);
+
+        GLuint destination = mPartials[pass & 1].name();
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, source);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, destination);
+
+        mProgram.set(COUNT_LOCATION, count);
+        dispatch(mProgram, groups);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        source = destination;
+        count  = groups;
+        pass++;
+    } while(count > 1);
+
+    copyBytes(source, result, resultOffset, sizeof(GLuint));
+}
+
+simgll::compute::ArgReduce::ArgReduce(Type type, Op op)
+{
+    build(mFirstProgram, type, opDefines(op) + "#define FIRST_PASS\n",
+          ARG_REDUCE_SOURCE);
+    build(mProgram, type, opDefines(op), ARG_REDUCE_SOURCE);
+}
+
+GLvoid simgll::compute::ArgReduce::run(GLuint input, GLuint count,
+                                       GLuint result, GLintptr resultOffset,
+                                       GLuint segments)
+{
+    if(count == 0 || segments == 0)
+    {
+        return;
+    }
+
+    // Every partial result is a (value, index) pair
+    GLuint segmentSize = count / segments;
+    GLuint groups      = groupCount(segmentSize, TILE_SIZE);
+    reserve(mPartials[0], 2 * groups * segments);
+    reserve(mPartials[1], 2 * groups * segments);
+
+    GLuint source = input;
+    GLuint pass   = 0;
+
+    do
+    {
+        groups = groupCount(segmentSize, TILE_SIZE);
+
+        ShaderProgram& program = pass == 0 ? mFirstProgram : mProgram;
+        GLuint destination = mPartials[pass & 1].name();
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, source);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, destination);
+
+        program.set(COUNT_LOCATION, segmentSize);
+        program.set(SEGMENT_GROUPS_LOCATION, groups);
+        dispatch(program, groups * segments);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        source      = destination;
+        segmentSize = groups;
+        pass++;
+    } while(segmentSize > 1);
+
+    copyBytes(source, result, resultOffset, 2 * sizeof(GLuint) * segments);
+}
+
+simgll::compute::Compact::Compact(Type type) :
+    mScan(Type::Uint, GL_FALSE)
+{
+    build(mScatterProgram, type, "", COMPACT_SOURCE);
+}
+
+GLvoid simgll::compute::Compact::run(GLuint input, GLuint flags,
+                                     GLuint output, GLuint count,
+                                     GLuint countBuffer, GLintptr countOffset)
+{
+    if(count == 0)
+    {
+        // Clearing with a null pointer writes zeros
+        glBindBuffer(GL_COPY_WRITE_BUFFER, countBuffer);
+        glClearBufferSubData(GL_COPY_WRITE_BUFFER, GL_R32UI, countOffset,
+                             sizeof(GLuint), GL_RED_INTEGER,
+                             GL_UNSIGNED_INT, nullptr);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        return;
+    }
+
+    reserve(mIndices, count);
+    reserve(mCount, 1);
+
+    mScan.run(flags, mIndices.name(), count);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, input);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, flags);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mIndices.name());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, output);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mCount.name());
+
+    mScatterProgram.set(COUNT_LOCATION, count);
+    dispatch(mScatterProgram, groupCount(count, TILE_SIZE));
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    copyBytes(mCount.name(), countBuffer, countOffset, sizeof(GLuint));
+}
+
+simgll::compute::RadixSort::RadixSort(Type type, GLboolean withValues) :
+    mScan(Type::Uint, GL_FALSE),
+    mWithValues(withValues)
+{
+    std::string defines = withValues ? "#define WITH_VALUES\n" : "";
+
+    build(mHistogramProgram, type, "", HISTOGRAM_SOURCE);
+    build(mScatterProgram, type, defines, SCATTER_SOURCE);
+}
+
+GLvoid simgll::compute::RadixSort::run(GLuint keys, GLuint count,
+                                       GLuint values)
+{
+    if(count <= 1)
+    {
+        return;
+    }
+
+    GLuint groups = groupCount(count, LOCAL_SIZE);
+
+    reserve(mHistogram, 16 * groups);
+    reserve(mKeys, count);
+
+    if(mWithValues)
+    {
+        reserve(mValues, count);
+    }
+
+    GLuint keysIn    = keys;
+    GLuint keysOut   = mKeys.name();
+    GLuint valuesIn  = values;
+    GLuint valuesOut = mValues.name();
+
+    // Eight passes, so the sorted keys end up back in the caller's buffer
+    for(GLuint shift = 0; shift < 32; shift += 4)
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, keysIn);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mHistogram.name());
+
+        mHistogramProgram.set(COUNT_LOCATION, count);
+        mHistogramProgram.set(SHIFT_LOCATION, shift);
+        dispatch(mHistogramProgram, groups);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        mScan.run(mHistogram.name(), mHistogram.name(), 16 * groups);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, keysIn);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, keysOut);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mHistogram.name());
+
+        if(mWithValues)
+        {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, valuesIn);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, valuesOut);
+        }
+
+        mScatterProgram.set(COUNT_LOCATION, count);
+        mScatterProgram.set(SHIFT_LOCATION, shift);
+        dispatch(mScatterProgram, groups);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        std::swap(keysIn, keysOut);
+        std::swap(valuesIn, valuesOut);
+    }
+}
@@ -0,0 +1,274 @@
+#include <iostream>
+#include <GLFW/glfw3.h>
+
+#ifdef SIMGLL_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "context.h"
+
+simgll::Context::Context(Type type, GLuint width, GLuint height,
+                         const std::string& title, GLint major, GLint minor) :
+    mType(type)
+{
+    if(mType == Type::Window)
+    {
+        createWindow(width, height, title, major, minor);
+    }
+    else
+    {
+        createHeadless(width, height, major, minor);
+    }
+
+    initGlew();
+}
+
+simgll::Context::~Context()
+{
+    if(mWindow)
+    {
+        glfwDestroyWindow(mWindow);
+        glfwTerminate();
+    }
+
+#ifdef SIMGLL_EGL
+    if(mEglDisplay)
+    {
+        eglMakeCurrent(mEglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+
+        if(mEglSurface)
+        {
+            eglDestroySurface(mEglDisplay, mEglSurface);
+        }
+
+        if(mEglContext)
+        {
+            eglDestroyContext(mEglDisplay, mEglContext);
+        }
+
+        eglTerminate(mEglDisplay);
+    }
+#endif
+}
+
+simgll::Context::Type simgll::Context::type() const
+{
+    return mType;
+}
+
+GLFWwindow* simgll::Context::window() const
+{
+    return mWindow;
+}
+
+GLboolean simgll::Context::shouldClose() const
+{
+    if(mWindow)
+    {
+        return glfwWindowShouldClose(mWindow) ? GL_TRUE : GL_FALSE;
+    }
+
+    return mShouldClose;
+}
+
+GLvoid simgll::Context::setShouldClose(GLboolean value)
+{
+    if(mWindow)
+    {
+        glfwSetWindowShouldClose(mWindow, value);
+    }
+
+    mShouldClose = value;
+}
+
+GLvoid simgll::Context::pollEvents()
+{
+    if(mWindow)
+    {
+        glfwPollEvents();
+    }
+}
+
+GLvoid simgll::Context::swapBuffers()
+{
+    if(mWindow)
+    {
+        glfwSwapBuffers(mWindow);
+    }
+}
+
+GLvoid simgll::Context::createWindow(GLuint width, GLuint height,
+                                     const std::string& title, GLint major,
+                                     GLint minor)
+{
+    if(!glfwInit())
+    {
+        std::cerr << "GLFW Error: Can't initialize GLFW.\n";
+
+        exit(1);
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+
+    mWindow = glfwCreateWindow(width, height, title.c_str(), nullptr,
+                               nullptr);
+
+    if(!mWindow)
+    {
+        std::cerr << "GLFW Error: Can't create window.\n";
+
+        glfwTerminate();
+        exit(1);
+    }
+
+    glfwMakeContextCurrent(mWindow);
+}
+
+#ifdef SIMGLL_EGL
+GLvoid simgll::Context::createHeadless(GLuint width, GLuint height,
+                                       GLint major, GLint minor)
+{
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY,
+                                                  EGL_EXTENSIONS);
+    std::string extensions = clientExtensions ? clientExtensions : "";
+
+    // Prefer Mesa's surfaceless platform, it doesn't need an X or Wayland
+    // server and works with llvmpipe on machines without a GPU
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+    if(getPlatformDisplay &&
+       extensions.find("EGL_MESA_platform_surfaceless") != std::string::npos)
+    {
+        mEglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                         EGL_DEFAULT_DISPLAY, nullptr);
+    }
+
+    if(!mEglDisplay)
+    {
+        mEglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint eglMajor, eglMinor;
+
+    if(mEglDisplay == EGL_NO_DISPLAY ||
+       !eglInitialize(mEglDisplay, &eglMajor, &eglMinor))
+    {
+        std::cerr << "EGL Error: Can't initialize display.\n";
+
+        exit(1);
+    }
+
+    if(!eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cerr << "EGL Error: OpenGL API not supported.\n";
+
+        exit(1);
+    }
+
+    std::string displayExtensions = eglQueryString(mEglDisplay,
+                                                   EGL_EXTENSIONS);
+    GLboolean surfaceless =
+        displayExtensions.find("EGL_KHR_surfaceless_context") != std::string::npos;
+    GLboolean configless =
+        displayExtensions.find("EGL_KHR_no_config_context") != std::string::npos;
+
+    const EGLint configAttribs[] =
+    {
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig config = nullptr;
+    EGLint numConfigs = 0;
+
+    eglChooseConfig(mEglDisplay, configAttribs, &config, 1, &numConfigs);
+
+    // The surfaceless platform exposes no configs at all, in that case the
+    // context is created without one
+    if(numConfigs == 0 && !(surfaceless && configless))
+    {
+        std::cerr << "EGL Error: No suitable config found.\n";
+
+        exit(1);
+    }
+
+    const EGLint contextAttribs[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION,       major,
+        EGL_CONTEXT_MINOR_VERSION,       minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    mEglContext = eglCreateContext(mEglDisplay,
+                                   numConfigs ? config : EGL_NO_CONFIG_KHR,
+                                   EGL_NO_CONTEXT, contextAttribs);
+
+    if(mEglContext == EGL_NO_CONTEXT)
+    {
+        std::cerr << "EGL Error: Can't create OpenGL " << major << "." <<
+            minor << " context.\n";
+
+        exit(1);
+    }
+
+    if(!surfaceless)
+    {
+        const EGLint pbufferAttribs[] =
+        {
+            EGL_WIDTH,  static_cast<EGLint>(width),
+            EGL_HEIGHT, static_cast<EGLint>(height),
+            EGL_NONE
+        };
+
+        mEglSurface = eglCreatePbufferSurface(mEglDisplay, config,
+                                              pbufferAttribs);
+
+        if(mEglSurface == EGL_NO_SURFACE)
+        {
+            std::cerr << "EGL Error: Can't create pbuffer surface.\n";
+
+            exit(1);
+        }
+    }
+
+    EGLSurface surface = mEglSurface ? mEglSurface : EGL_NO_SURFACE;
+
+    if(!eglMakeCurrent(mEglDisplay, surface, surface, mEglContext))
+    {
+        std::cerr << "EGL Error: Can't make context current.\n";
+
+        exit(1);
+    }
+}
+#else
+GLvoid simgll::Context::createHeadless(GLuint, GLuint, GLint, GLint)
+{
+    std::cerr << "Headless contexts require EGL support.\n";
+
+    exit(1);
+}
+#endif
+
+GLvoid simgll::Context::initGlew()
+{
+    glewExperimental = GL_TRUE;
+
+    // glewInit() queries the window system (GLX/WGL) which isn't available
+    // with an EGL context, in that case only the core entry points are loaded
+    GLenum status = mWindow ? glewInit() : glewContextInit();
+
+    if(status != GLEW_OK)
+    {
+        std::cerr << "GLEW Error: " << glewGetErrorString(status) << "\n";
+
+        exit(1);
+    }
+}
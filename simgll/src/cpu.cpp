@@ -0,0 +1,709 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "cpu.h"
+#include "random.h"
+#include "threadpool.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+using simgll::cpu::Op;
+
+namespace
+{
+    // Elements per task of the memory bound loops and particles per task of
+    // the simulation updates
+    const std::size_t STREAM_GRAIN   = 1 << 16;
+    const std::size_t PARTICLE_GRAIN = 1 << 10;
+
+    // Number of chunks a scan is split in, a few per thread so that the
+    // chunks of a busy thread are picked up by the others
+    std::size_t scanChunks(std::size_t count)
+    {
+        std::size_t chunks = simgll::ThreadPool::global().size() * 4;
+
+        return std::max<std::size_t>(1, std::min(chunks, count / STREAM_GRAIN));
+    }
+
+    template<typename T>
+    T chunkSum(const T* input, std::size_t first, std::size_t last)
+    {
+        T sum = 0;
+
+        for(std::size_t i = first; i < last; i++)
+        {
+            sum += input[i];
+        }
+
+        return sum;
+    }
+
+#if defined(__SSE2__)
+    template<>
+    GLfloat chunkSum<GLfloat>(const GLfloat* input, std::size_t first,
+                              std::size_t last)
+    {
+        __m128 sum = _mm_setzero_ps();
+        std::size_t i = first;
+
+        for(; i + 4 <= last; i += 4)
+        {
+            sum = _mm_add_ps(sum, _mm_loadu_ps(input + i));
+        }
+
+        GLfloat lanes[4];
+        _mm_storeu_ps(lanes, sum);
+
+        GLfloat total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+        for(; i < last; i++)
+        {
+            total += input[i];
+        }
+
+        return total;
+    }
+
+    // Inclusive scan of the four lanes of x
+    inline __m128 scanLanes(__m128 x)
+    {
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+
+        return x;
+    }
+
+    inline __m128i scanLanes(__m128i x)
+    {
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+
+        return x;
+    }
+
+    GLfloat scanChunk(const GLfloat* input, GLfloat* output, std::size_t first,
+                      std::size_t last, GLfloat offset, GLboolean inclusive)
+    {
+        __m128 carry = _mm_set1_ps(offset);
+        std::size_t i = first;
+
+        for(; i + 4 <= last; i += 4)
+        {
+            __m128 x    = _mm_loadu_ps(input + i);
+            __m128 sums = scanLanes(x);
+
+            // The exclusive sums are the inclusive ones shifted by one lane
+            __m128 out = inclusive ? sums
+                : _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(sums), 4));
+
+            _mm_storeu_ps(output + i, _mm_add_ps(carry, out));
+            carry = _mm_add_ps(carry, _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(3, 3, 3, 3)));
+        }
+
+        offset = _mm_cvtss_f32(carry);
+
+        for(; i < last; i++)
+        {
+            GLfloat x = input[i];
+
+            output[i] = inclusive ? offset + x : offset;
+            offset += x;
+        }
+
+        return offset;
+    }
+
+    GLuint scanChunk(const GLuint* input, GLuint* output, std::size_t first,
+                     std::size_t last, GLuint offset, GLboolean inclusive)
+    {
+        __m128i carry = _mm_set1_epi32(static_cast<int>(offset));
+        std::size_t i = first;
+
+        for(; i + 4 <= last; i += 4)
+        {
+            __m128i x    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            __m128i sums = scanLanes(x);
+            __m128i out  = inclusive ? sums : _mm_slli_si128(sums, 4);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_add_epi32(carry, out));
+            carry = _mm_add_epi32(carry, _mm_shuffle_epi32(sums, _MM_SHUFFLE(3, 3, 3, 3)));
+        }
+
+        offset = static_cast<GLuint>(_mm_cvtsi128_si32(carry));
+
+        for(; i < last; i++)
+        {
+            GLuint x = input[i];
+
+            output[i] = inclusive ? offset + x : offset;
+            offset += x;
+        }
+
+        return offset;
+    }
+#else
+    template<typename T>
+    T scanChunk(const T* input, T* output, std::size_t first, std::size_t last,
+                T offset, GLboolean inclusive)
+    {
+        for(std::size_t i = first; i < last; i++)
+        {
+            T x = input[i];
+
+            output[i] = inclusive ? offset + x : offset;
+            offset += x;
+        }
+
+        return offset;
+    }
+#endif
+
+    // Reduce then scan: the chunk totals are computed in parallel, scanned
+    // serially and every chunk is scanned from its offset
+    template<typename T>
+    GLvoid parallelScan(const T* input, T* output, std::size_t count,
+                        GLboolean inclusive)
+    {
+        simgll::ThreadPool& pool = simgll::ThreadPool::global();
+
+        std::size_t chunks = scanChunks(count);
+        std::size_t size   = (count + chunks - 1) / chunks;
+
+        std::vector<T> offsets(chunks, 0);
+
+        // The last chunk total is not needed, and reading the input ahead of
+        // the scan keeps it correct when output aliases input
+        pool.parallelFor(0, chunks - 1, 1, [&](std::size_t first, std::size_t last)
+        {
+            for(std::size_t c = first; c < last; c++)
+            {
+                offsets[c + 1] = chunkSum(input, c * size, std::min((c + 1) * size, count));
+            }
+        });
+
+        for(std::size_t c = 1; c < chunks; c++)
+        {
+            offsets[c] += offsets[c - 1];
+        }
+
+        pool.parallelFor(0, chunks, 1, [&](std::size_t first, std::size_t last)
+        {
+            for(std::size_t c = first; c < last; c++)
+            {
+                scanChunk(input, output, c * size, std::min((c + 1) * size, count),
+                          offsets[c], inclusive);
+            }
+        });
+    }
+
+    // One functor per operation, the loop is instantiated for each of them
+    // so that the operation is not selected per element
+    struct Add
+    {
+        static GLfloat apply(GLfloat a, GLfloat b) { return a + b; }
+#if defined(__SSE2__)
+        static __m128 apply(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+#endif
+#if defined(__AVX__)
+        static __m256 apply(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+#endif
+    };
+
+    struct Subtract
+    {
+        static GLfloat apply(GLfloat a, GLfloat b) { return a - b; }
+#if defined(__SSE2__)
+        static __m128 apply(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+#endif
+#if defined(__AVX__)
+        static __m256 apply(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+#endif
+    };
+
+    struct Multiply
+    {
+        static GLfloat apply(GLfloat a, GLfloat b) { return a * b; }
+#if defined(__SSE2__)
+        static __m128 apply(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+#endif
+#if defined(__AVX__)
+        static __m256 apply(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+#endif
+    };
+
+    struct Divide
+    {
+        static GLfloat apply(GLfloat a, GLfloat b) { return a / b; }
+#if defined(__SSE2__)
+        static __m128 apply(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+#endif
+#if defined(__AVX__)
+        static __m256 apply(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+#endif
+    };
+
+    // Same operand order as the instructions, b is returned if either is NaN
+    struct Min
+    {
+        static GLfloat apply(GLfloat a, GLfloat b) { return a < b ? a : b; }
+#if defined(__SSE2__)
+        static __m128 apply(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+#endif
+#if defined(__AVX__)
+        static __m256 apply(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+#endif
+    };
+
+    struct Max
+    {
+        static GLfloat apply(GLfloat a, GLfloat b) { return a > b ? a : b; }
+#if defined(__SSE2__)
+        static __m128 apply(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+#endif
+#if defined(__AVX__)
+        static __m256 apply(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+#endif
+    };
+
+    template<typename Kernel>
+    GLvoid elementWiseRange(const GLfloat* a, const GLfloat* b, GLfloat* output,
+                            std::size_t first, std::size_t last)
+    {
+        std::size_t i = first;
+
+#if defined(__AVX__)
+        for(; i + 8 <= last; i += 8)
+        {
+            _mm256_storeu_ps(output + i, Kernel::apply(_mm256_loadu_ps(a + i),
+                                                       _mm256_loadu_ps(b + i)));
+        }
+#endif
+
+#if defined(__SSE2__)
+        for(; i + 4 <= last; i += 4)
+        {
+            _mm_storeu_ps(output + i, Kernel::apply(_mm_loadu_ps(a + i),
+                                                    _mm_loadu_ps(b + i)));
+        }
+#endif
+
+        for(; i < last; i++)
+        {
+            output[i] = Kernel::apply(a[i], b[i]);
+        }
+    }
+
+    template<typename Kernel>
+    GLvoid parallelElementWise(const GLfloat* a, const GLfloat* b,
+                               GLfloat* output, std::size_t count)
+    {
+        simgll::ThreadPool::global().parallelFor(0, count, STREAM_GRAIN,
+            [=](std::size_t first, std::size_t last)
+        {
+            elementWiseRange<Kernel>(a, b, output, first, last);
+        });
+    }
+
+    GLfloat dot3(const GLfloat a[3], const GLfloat b[3])
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // normalize() of GLSL, v / length(v)
+    GLvoid normalize3(GLfloat v[3])
+    {
+        GLfloat length = std::sqrt(dot3(v, v));
+
+        for(GLint d = 0; d < 3; d++)
+        {
+            v[d] /= length;
+        }
+    }
+
+    // cell_hash() of SBFlocking
+    GLuint cellHash(const GLint cell[3], GLuint tableSize)
+    {
+        return (static_cast<GLuint>(cell[0]) * 73856093u ^
+                static_cast<GLuint>(cell[1]) * 19349663u ^
+                static_cast<GLuint>(cell[2]) * 83492791u) & (tableSize - 1u);
+    }
+
+    GLvoid cellOf(const GLfloat position[3], GLfloat cellSize, GLint cell[3])
+    {
+        for(GLint d = 0; d < 3; d++)
+        {
+            cell[d] = static_cast<GLint>(std::floor(position[d] / cellSize));
+        }
+    }
+
+#if defined(__SSE2__)
+    // Dot product of the xyz lanes broadcast to every lane
+    inline __m128 dot3(__m128 a, __m128 b)
+    {
+        __m128 p = _mm_mul_ps(a, b);
+        __m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1));
+        __m128 z = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2));
+        __m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0));
+
+        return _mm_add_ps(_mm_add_ps(x, y), z);
+    }
+#endif
+}
+
+GLvoid simgll::cpu::scan(const GLfloat* input, GLfloat* output,
+                         std::size_t count, GLboolean inclusive)
+{
+    parallelScan(input, output, count, inclusive);
+}
+
+GLvoid simgll::cpu::scan(const GLuint* input, GLuint* output,
+                         std::size_t count, GLboolean inclusive)
+{
+    parallelScan(input, output, count, inclusive);
+}
+
+GLvoid simgll::cpu::elementWise(Op op, const GLfloat* a, const GLfloat* b,
+                                GLfloat* output, std::size_t count)
+{
+    switch(op)
+    {
+    case Op::Add:
+        parallelElementWise<Add>(a, b, output, count);
+        break;
+    case Op::Subtract:
+        parallelElementWise<Subtract>(a, b, output, count);
+        break;
+    case Op::Multiply:
+        parallelElementWise<Multiply>(a, b, output, count);
+        break;
+    case Op::Divide:
+        parallelElementWise<Divide>(a, b, output, count);
+        break;
+    case Op::Min:
+        parallelElementWise<Min>(a, b, output, count);
+        break;
+    case Op::Max:
+        parallelElementWise<Max>(a, b, output, count);
+        break;
+    }
+}
+
+GLvoid simgll::cpu::psoUpdate(const Objective& objective, GLuint dimensions,
+                              const Particle* input, Particle* output,
+                              std::size_t count, const GlobalBest& best,
+                              GLfloat omega, GLuint seed, GLuint counter)
+{
+    const GLfloat range = objective.upper - objective.lower;
+
+    ThreadPool::global().parallelFor(0, count, PARTICLE_GRAIN,
+        [&](std::size_t first, std::size_t last)
+    {
+        for(std::size_t i = first; i < last; i++)
+        {
+            const Particle& pIn = input[i];
+            Particle pOut = pIn;
+
+            std::array<GLuint, 4> rand = philox(seed, static_cast<GLuint>(i), counter);
+
+            GLfloat k1 = uniformFloat(rand[0]);
+            GLfloat k2 = uniformFloat(rand[1]);
+
+            for(GLint d = 0; d < 3; d++)
+            {
+                pOut.velocity[d] = omega * pIn.velocity[d] +
+                    2.0f * k1 * (pIn.bestPosition[d] - pIn.position[d]) +
+                    2.0f * k2 * (best.position[d] - pIn.position[d]);
+            }
+
+            if(std::sqrt(dot3(pOut.velocity, pOut.velocity)) > range)
+            {
+                normalize3(pOut.velocity);
+
+                for(GLint d = 0; d < 3; d++)
+                {
+                    pOut.velocity[d] *= range;
+                }
+            }
+
+            for(GLint d = 0; d < 3; d++)
+            {
+                pOut.position[d] = pIn.position[d] + pOut.velocity[d];
+            }
+
+            pOut.fitness = objective.evaluate(pOut.position, dimensions);
+
+            for(GLint d = 0; d < 3; d++)
+            {
+                pOut.bestPosition[d] = pOut.fitness < pIn.fitness ?
+                    pOut.position[d] : pIn.bestPosition[d];
+            }
+
+            output[i] = pOut;
+        }
+    });
+}
+
+GLvoid simgll::cpu::flockUpdate(const FlockMember* input, FlockMember* output,
+                                std::size_t count,
+                                const FlockParameters& parameters,
+                                GLuint tableSize)
+{
+    const GLfloat cellSize = std::sqrt(parameters.closestAllowedDist);
+
+    // Counting sort of the members by hashed cell, the same grid the
+    // grid_count and grid_scatter shaders build
+    std::vector<GLuint> memberCell(count);
+    std::vector<GLuint> cellStart(tableSize + 1, 0);
+    std::vector<GLuint> sorted(count);
+
+    ThreadPool::global().parallelFor(0, count, PARTICLE_GRAIN,
+        [&](std::size_t first, std::size_t last)
+    {
+        for(std::size_t i = first; i < last; i++)
+        {
+            GLint cell[3];
+            cellOf(input[i].position, cellSize, cell);
+            memberCell[i] = cellHash(cell, tableSize);
+        }
+    });
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        cellStart[memberCell[i] + 1]++;
+    }
+
+    for(GLuint c = 0; c < tableSize; c++)
+    {
+        cellStart[c + 1] += cellStart[c];
+    }
+
+    std::vector<GLuint> cursor(cellStart.begin(), cellStart.end() - 1);
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        sorted[cursor[memberCell[i]]++] = static_cast<GLuint>(i);
+    }
+
+    GLdouble sum[3] = { 0.0, 0.0, 0.0 };
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        for(GLint d = 0; d < 3; d++)
+        {
+            sum[d] += input[i].position[d];
+        }
+    }
+
+    GLfloat center[3];
+
+    for(GLint d = 0; d < 3; d++)
+    {
+        center[d] = static_cast<GLfloat>(sum[d] / static_cast<GLdouble>(count));
+    }
+
+    ThreadPool::global().parallelFor(0, count, PARTICLE_GRAIN,
+        [&](std::size_t first, std::size_t last)
+    {
+        for(std::size_t i = first; i < last; i++)
+        {
+            const FlockMember& me = input[i];
+            GLfloat acceleration[3] = { 0.0f, 0.0f, 0.0f };
+
+            GLint myCell[3];
+            cellOf(me.position, cellSize, myCell);
+
+            // Different cells can share a hash, every hash is visited once
+            GLuint visited[27];
+            GLint numVisited = 0;
+
+            for(GLint z = -1; z <= 1; z++)
+            for(GLint y = -1; y <= 1; y++)
+            for(GLint x = -1; x <= 1; x++)
+            {
+                GLint neighbor[3] = { myCell[0] + x, myCell[1] + y, myCell[2] + z };
+                GLuint cell = cellHash(neighbor, tableSize);
+
+                if(std::find(visited, visited + numVisited, cell) != visited + numVisited)
+                {
+                    continue;
+                }
+
+                visited[numVisited++] = cell;
+
+                for(GLuint j = cellStart[cell]; j < cellStart[cell + 1]; j++)
+                {
+                    const FlockMember& them = input[sorted[j]];
+                    GLfloat d[3], dv[3];
+
+                    for(GLint k = 0; k < 3; k++)
+                    {
+                        d[k]  = me.position[k] - them.position[k];
+                        dv[k] = them.velocity[k] - me.velocity[k];
+                    }
+
+                    GLfloat distance = dot3(d, d);
+
+                    if(sorted[j] == i || distance >= parameters.closestAllowedDist)
+                    {
+                        continue;
+                    }
+
+                    // Separation and alignment, rule1 and rule2 of the shader
+                    for(GLint k = 0; k < 3; k++)
+                    {
+                        acceleration[k] += d[k] * parameters.rule1Weight;
+                        acceleration[k] += dv[k] / (distance + 10.0f) * parameters.rule2Weight;
+                    }
+                }
+            }
+
+            GLfloat toGoal[3], toCenter[3];
+
+            for(GLint k = 0; k < 3; k++)
+            {
+                toGoal[k]   = parameters.goal[k] - me.position[k];
+                toCenter[k] = center[k] - me.position[k];
+            }
+
+            normalize3(toGoal);
+            normalize3(toCenter);
+
+            FlockMember newMe = me;
+
+            for(GLint k = 0; k < 3; k++)
+            {
+                newMe.position[k] = me.position[k] + me.velocity[k] * parameters.timestep;
+                acceleration[k] += toGoal[k] * parameters.rule3Weight;
+                acceleration[k] += toCenter[k] * parameters.rule4Weight;
+                newMe.velocity[k] = me.velocity[k] + acceleration[k] * parameters.timestep;
+            }
+
+            if(std::sqrt(dot3(newMe.velocity, newMe.velocity)) > 10.0f)
+            {
+                normalize3(newMe.velocity);
+
+                for(GLint k = 0; k < 3; k++)
+                {
+                    newMe.velocity[k] *= 10.0f;
+                }
+            }
+
+            // mix(me.velocity, new_me.velocity, 0.4)
+            for(GLint k = 0; k < 3; k++)
+            {
+                newMe.velocity[k] = me.velocity[k] * 0.6f + newMe.velocity[k] * 0.4f;
+            }
+
+            output[i] = newMe;
+        }
+    });
+}
+
+GLvoid simgll::cpu::particleUpdate(GLfloat* positions, GLfloat* velocities,
+                                   std::size_t count, const GLfloat* attractors,
+                                   std::size_t attractorCount, GLfloat dt)
+{
+    ThreadPool::global().parallelFor(0, count, PARTICLE_GRAIN,
+        [=](std::size_t first, std::size_t last)
+    {
+#if defined(__SSE2__)
+        // The velocity moves xyz, w is the life lost every step
+        const __m128 step = _mm_set_ps(0.0f, dt, dt, dt);
+        const __m128 life = _mm_set_ps(-0.0001f * dt, 0.0f, 0.0f, 0.0f);
+        const __m128 xyz  = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+        for(std::size_t i = first; i < last; i++)
+        {
+            __m128 pos = _mm_loadu_ps(positions + 4 * i);
+            __m128 vel = _mm_loadu_ps(velocities + 4 * i);
+
+            pos = _mm_add_ps(_mm_add_ps(pos, _mm_mul_ps(vel, step)), life);
+
+            for(std::size_t j = 0; j < attractorCount; j++)
+            {
+                __m128 attractor = _mm_loadu_ps(attractors + 4 * j);
+                __m128 dist      = _mm_and_ps(_mm_sub_ps(attractor, pos), xyz);
+                __m128 distance2 = dot3(dist, dist);
+
+                // dt * dt * mass * normalize(dist) / (dot(dist, dist) + 10)
+                __m128 mass  = _mm_shuffle_ps(attractor, attractor, _MM_SHUFFLE(3, 3, 3, 3));
+                __m128 scale = _mm_div_ps(_mm_mul_ps(_mm_set1_ps(dt * dt), mass),
+                                          _mm_mul_ps(_mm_sqrt_ps(distance2),
+                                                     _mm_add_ps(distance2, _mm_set1_ps(10.0f))));
+
+                vel = _mm_add_ps(vel, _mm_mul_ps(dist, scale));
+            }
+
+            _mm_storeu_ps(positions + 4 * i, pos);
+            _mm_storeu_ps(velocities + 4 * i, vel);
+        }
+#else
+        for(std::size_t i = first; i < last; i++)
+        {
+            GLfloat* pos = positions + 4 * i;
+            GLfloat* vel = velocities + 4 * i;
+
+            for(GLint d = 0; d < 3; d++)
+            {
+                pos[d] += vel[d] * dt;
+            }
+
+            pos[3] -= 0.0001f * dt;
+
+            for(std::size_t j = 0; j < attractorCount; j++)
+            {
+                const GLfloat* attractor = attractors + 4 * j;
+                GLfloat dist[3];
+
+                for(GLint d = 0; d < 3; d++)
+                {
+                    dist[d] = attractor[d] - pos[d];
+                }
+
+                GLfloat distance2 = dot3(dist, dist);
+                GLfloat scale = dt * dt * attractor[3] /
+                    (std::sqrt(distance2) * (distance2 + 10.0f));
+
+                for(GLint d = 0; d < 3; d++)
+                {
+                    vel[d] += dist[d] * scale;
+                }
+            }
+        }
+#endif
+    });
+}
+
+std::size_t simgll::cpu::countMismatches(const GLfloat* actual,
+                                         std::size_t actualStride,
+                                         const GLfloat* expected,
+                                         std::size_t expectedStride,
+                                         std::size_t count,
+                                         std::size_t components,
+                                         GLfloat tolerance)
+{
+    std::size_t mismatches = 0;
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        const GLfloat* a = actual + i * actualStride;
+        const GLfloat* e = expected + i * expectedStride;
+
+        for(std::size_t c = 0; c < components; c++)
+        {
+            // NaNs fail the comparison and count as mismatches
+            if(!(std::abs(a[c] - e[c]) <= tolerance * std::max(1.0f, std::abs(e[c]))))
+            {
+                mismatches++;
+            }
+        }
+    }
+
+    return mismatches;
+}
@@ -0,0 +1,262 @@
+#include <cmath>
+#include <deque>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include "objective.h"
+
+namespace
+{
+    const GLfloat PI = 3.14159265358979F;
+
+    std::deque<simgll::Objective> builtins()
+    {
+        std::deque<simgll::Objective> objectives;
+
+        // Global minimum = f(0, ..., 0) = 0
+        objectives.push_back({ "sphere", 0, -5.12F, 5.12F, 0.0F, R"(
+    float s = 0.0;
+
+    for(int i = 0; i < DIM; i++)
+    {
+        s += x[i] * x[i];
+    }
+
+    return s;
+)",
+            [](const GLfloat* x, GLuint n)
+            {
+                GLfloat s = 0.0F;
+
+                for(GLuint i = 0; i < n; i++)
+                {
+                    s += x[i] * x[i];
+                }
+
+                return s;
+            } });
+
+        // Global minimum = f(0, ..., 0) = 0
+        objectives.push_back({ "rastrigin", 0, -5.12F, 5.12F, 0.0F, R"(
+    float s = 10.0 * DIM;
+
+    for(int i = 0; i < DIM; i++)
+    {
+        s += x[i] * x[i] - 10.0 * cos(2.0 * PI * x[i]);
+    }
+
+    return s;
+)",
+            [](const GLfloat* x, GLuint n)
+            {
+                GLfloat s = 10.0F * n;
+
+                for(GLuint i = 0; i < n; i++)
+                {
+                    s += x[i] * x[i] - 10.0F * std::cos(2.0F * PI * x[i]);
+                }
+
+                return s;
+            } });
+
+        // Global minimum = f(1, ..., 1) = 0
+        objectives.push_back({ "rosenbrock", 0, -5.0F, 10.0F, 0.0F, R"(
+    float s = 0.0;
+
+    for(int i = 0; i < DIM - 1; i++)
+    {
+        float a = x[i + 1] - x[i] * x[i];
+        float b = 1.0 - x[i];
+
+        s += 100.0 * a * a + b * b;
+    }
+
+    return s;
+)",
+            [](const GLfloat* x, GLuint n)
+            {
+                GLfloat s = 0.0F;
+
+                for(GLuint i = 0; i + 1 < n; i++)
+                {
+                    GLfloat a = x[i + 1] - x[i] * x[i];
+                    GLfloat b = 1.0F - x[i];
+
+                    s += 100.0F * a * a + b * b;
+                }
+
+                return s;
+            } });
+
+        // Global minimum = f(0, ..., 0) = 0
+        objectives.push_back({ "ackley", 0, -32.768F, 32.768F, 0.0F, R"(
+    float s1 = 0.0;
+    float s2 = 0.0;
+
+    for(int i = 0; i < DIM; i++)
+    {
+        s1 += x[i] * x[i];
+        s2 += cos(2.0 * PI * x[i]);
+    }
+
+    return -20.0 * exp(-0.2 * sqrt(s1 / DIM)) - exp(s2 / DIM) + 20.0 + E;
+)",
+            [](const GLfloat* x, GLuint n)
+            {
+                GLfloat s1 = 0.0F;
+                GLfloat s2 = 0.0F;
+
+                for(GLuint i = 0; i < n; i++)
+                {
+                    s1 += x[i] * x[i];
+                    s2 += std::cos(2.0F * PI * x[i]);
+                }
+
+                return -20.0F * std::exp(-0.2F * std::sqrt(s1 / n)) -
+                       std::exp(s2 / n) + 20.0F + std::exp(1.0F);
+            } });
+
+        // Global minimum = f(0, ..., 0) = 0
+        objectives.push_back({ "griewank", 0, -600.0F, 600.0F, 0.0F, R"(
+    float s = 0.0;
+    float p = 1.0;
+
+    for(int i = 0; i < DIM; i++)
+    {
+        s += x[i] * x[i];
+        p *= cos(x[i] / sqrt(float(i + 1)));
+    }
+
+    return 1.0 + s / 4000.0 - p;
+)",
+            [](const GLfloat* x, GLuint n)
+            {
+                GLfloat s = 0.0F;
+                GLfloat p = 1.0F;
+
+                for(GLuint i = 0; i < n; i++)
+                {
+                    s += x[i] * x[i];
+                    p *= std::cos(x[i] / std::sqrt(static_cast<GLfloat>(i + 1)));
+                }
+
+                return 1.0F + s / 4000.0F - p;
+            } });
+
+        // Global minimum = f(420.9687, ..., 420.9687) = 0
+        objectives.push_back({ "schwefel", 0, -500.0F, 500.0F, 0.0F, R"(
+    float s = 418.9829 * DIM;
+
+    for(int i = 0; i < DIM; i++)
+    {
+        s -= x[i] * sin(sqrt(abs(x[i])));
+    }
+
+    return s;
+)",
+            [](const GLfloat* x, GLuint n)
+            {
+                GLfloat s = 418.9829F * n;
+
+                for(GLuint i = 0; i < n; i++)
+                {
+                    s -= x[i] * std::sin(std::sqrt(std::abs(x[i])));
+                }
+
+                return s;
+            } });
+
+        // Global minimum = f(0, -1) = 3
+        objectives.push_back({ "goldsteinPrice", 2, -2.0F, 2.0F, 3.0F, R"(
+    float a = x[0] + x[1] + 1.0;
+    float b = 2.0 * x[0] - 3.0 * x[1];
+
+    return (1.0 + a * a * (19.0 - 14.0 * x[0] + 3.0 * x[0] * x[0] -
+                           14.0 * x[1] + 6.0 * x[0] * x[1] +
+                           3.0 * x[1] * x[1])) *
+           (30.0 + b * b * (18.0 - 32.0 * x[0] + 12.0 * x[0] * x[0] +
+                            48.0 * x[1] - 36.0 * x[0] * x[1] +
+                            27.0 * x[1] * x[1]));
+)",
+            [](const GLfloat* x, GLuint)
+            {
+                GLfloat a = x[0] + x[1] + 1.0F;
+                GLfloat b = 2.0F * x[0] - 3.0F * x[1];
+
+                return (1.0F + a * a * (19.0F - 14.0F * x[0] + 3.0F * x[0] * x[0] -
+                                        14.0F * x[1] + 6.0F * x[0] * x[1] +
+                                        3.0F * x[1] * x[1])) *
+                       (30.0F + b * b * (18.0F - 32.0F * x[0] + 12.0F * x[0] * x[0] +
+                                         48.0F * x[1] - 36.0F * x[0] * x[1] +
+                                         27.0F * x[1] * x[1]));
+            } });
+
+        return objectives;
+    }
+
+    // A deque keeps the references returned by findObjective() valid when
+    // objectives are registered later
+    std::deque<simgll::Objective>& registry()
+    {
+        static std::deque<simgll::Objective> objectives = builtins();
+
+        return objectives;
+    }
+}
+
+std::string simgll::Objective::glsl(GLuint n) const
+{
+    std::ostringstream code;
+    code << std::setprecision(9) << std::showpoint;
+
+    code << "#define DIM " << n << "\n"
+         << "#define LOWER " << lower << "\n"
+         << "#define UPPER " << upper << "\n"
+         << "#define PI 3.14159265358979\n"
+         << "#define E 2.71828182845905\n"
+         << "\n"
+         << "float objective(float x[DIM])\n"
+         << "{" << body << "}\n";
+
+    return code.str();
+}
+
+GLvoid simgll::registerObjective(const Objective& objective)
+{
+    registry().push_back(objective);
+}
+
+const simgll::Objective& simgll::findObjective(const std::string& name)
+{
+    for(const Objective& objective : registry())
+    {
+        if(objective.name == name)
+        {
+            return objective;
+        }
+    }
+
+    std::cerr << "Unknown objective " << name << ", available:";
+
+    for(const std::string& available : objectiveNames())
+    {
+        std::cerr << " " << available;
+    }
+
+    std::cerr << std::endl;
+
+    exit(1);
+}
+
+std::vector<std::string> simgll::objectiveNames()
+{
+    std::vector<std::string> names;
+
+    for(const Objective& objective : registry())
+    {
+        names.push_back(objective.name);
+    }
+
+    return names;
+}
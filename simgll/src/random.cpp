@@ -0,0 +1,70 @@
+#include <cstdint>
+#include "random.h"
+
+namespace
+{
+    // Multipliers and Weyl sequence constants of Philox4x32
+    const GLuint MULTIPLIER_0 = 0xD2511F53u;
+    const GLuint MULTIPLIER_1 = 0xCD9E8D57u;
+    const GLuint WEYL_0       = 0x9E3779B9u;
+    const GLuint WEYL_1       = 0xBB67AE85u;
+    const GLint  ROUNDS       = 10;
+
+    const char* PHILOX_SOURCE = R"(
+uvec4 philox(uint seed, uint stream, uint counter)
+{
+    uvec4 c = uvec4(counter, 0u, 0u, 0u);
+    uvec2 k = uvec2(seed, stream);
+
+    for(int r = 0; r < 10; r++)
+    {
+        uint hi0, lo0, hi1, lo1;
+        umulExtended(0xD2511F53u, c.x, hi0, lo0);
+        umulExtended(0xCD9E8D57u, c.z, hi1, lo1);
+
+        c = uvec4(hi1 ^ c.y ^ k.x, lo1, hi0 ^ c.w ^ k.y, lo0);
+        k += uvec2(0x9E3779B9u, 0xBB67AE85u);
+    }
+
+    return c;
+}
+
+float uniform_float(uint bits)
+{
+    return float(bits >> 8) * (1.0 / 16777216.0);
+}
+
+vec4 uniform_float(uvec4 bits)
+{
+    return vec4(bits >> 8) * (1.0 / 16777216.0);
+}
+)";
+}
+
+std::array<GLuint, 4> simgll::philox(GLuint seed, GLuint stream,
+                                     GLuint counter)
+{
+    std::array<GLuint, 4> c = { { counter, 0, 0, 0 } };
+    GLuint k[2] = { seed, stream };
+
+    for(GLint r = 0; r < ROUNDS; r++)
+    {
+        std::uint64_t product0 = static_cast<std::uint64_t>(MULTIPLIER_0) * c[0];
+        std::uint64_t product1 = static_cast<std::uint64_t>(MULTIPLIER_1) * c[2];
+
+        c = { { static_cast<GLuint>(product1 >> 32) ^ c[1] ^ k[0],
+                static_cast<GLuint>(product1),
+                static_cast<GLuint>(product0 >> 32) ^ c[3] ^ k[1],
+                static_cast<GLuint>(product0) } };
+
+        k[0] += WEYL_0;
+        k[1] += WEYL_1;
+    }
+
+    return c;
+}
+
+std::string simgll::philoxGlsl()
+{
+    return PHILOX_SOURCE;
+}
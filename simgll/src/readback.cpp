@@ -0,0 +1,198 @@
+#include <iostream>
+#include "readback.h"
+
+simgll::ReadbackQueue::ReadbackQueue(GLsizeiptr capacity, GLuint depth) :
+    mCapacity(capacity),
+    mDepth(depth),
+    mSlots(depth + 1, Slot{ nullptr, 0, nullptr }),
+    mOrder(depth)
+{
+    // One slot more than can be in flight, so a callback still holding its
+    // slot can enqueue without waiting for another readback
+    mFree.reserve(depth + 1);
+
+    for(GLuint slot = depth + 1; slot > 0; slot--)
+    {
+        mFree.push_back(slot - 1);
+    }
+
+    const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT |
+                             GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &mName);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mName);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, mCapacity * (mDepth + 1), nullptr,
+                    flags | GL_CLIENT_STORAGE_BIT);
+    mData = static_cast<GLubyte*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+                                                   mCapacity * (mDepth + 1),
+                                                   flags));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+simgll::ReadbackQueue::~ReadbackQueue()
+{
+    for(auto& slot: mSlots)
+    {
+        glDeleteSync(slot.fence);
+    }
+
+    glDeleteBuffers(1, &mName);
+}
+
+GLvoid simgll::ReadbackQueue::enqueue(GLuint buffer, GLintptr offset,
+                                      GLsizeiptr size, Callback callback)
+{
+    if(size > mCapacity)
+    {
+        std::cerr << "Readback of " << size << " bytes exceeds capacity of "
+            << mCapacity << " bytes\n";
+
+        exit(1);
+    }
+
+    GLuint slot = acquire();
+
+    // Make shader writes visible to the copy
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mName);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset,
+                        slot * mCapacity, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    submit(slot, size, callback);
+}
+
+GLvoid simgll::ReadbackQueue::enqueueImage(GLenum target, GLuint texture,
+                                           GLint level, GLenum format,
+                                           GLenum type, GLsizeiptr size,
+                                           Callback callback)
+{
+    if(size > mCapacity)
+    {
+        std::cerr << "Readback of " << size << " bytes exceeds capacity of "
+            << mCapacity << " bytes\n";
+
+        exit(1);
+    }
+
+    GLuint slot = acquire();
+
+    // Make image stores visible to the pack operation
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, mName);
+    glBindTexture(target, texture);
+    glGetTexImage(target, level, format, type,
+                  reinterpret_cast<GLvoid*>(slot * mCapacity));
+    glBindTexture(target, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    submit(slot, size, callback);
+}
+
+GLuint simgll::ReadbackQueue::poll()
+{
+    GLuint delivered = 0;
+
+    while(mCount > 0)
+    {
+        // A zero timeout never blocks, the flush bit makes sure the fence
+        // eventually reaches the GPU
+        GLenum result = glClientWaitSync(mSlots[mOrder[mHead]].fence,
+                                         GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+        if(result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+        {
+            break;
+        }
+
+        deliver(GL_FALSE);
+        delivered++;
+    }
+
+    return delivered;
+}
+
+GLvoid simgll::ReadbackQueue::flush()
+{
+    while(mCount > 0)
+    {
+        deliver(GL_TRUE);
+    }
+}
+
+GLuint simgll::ReadbackQueue::pending() const
+{
+    return mCount;
+}
+
+GLuint simgll::ReadbackQueue::acquire()
+{
+    while(mCount == mDepth || mFree.empty())
+    {
+        // Every slot is held by a callback further up the stack
+        if(mCount == 0)
+        {
+            std::cerr << "Readback enqueued from " << mDepth + 1
+                << " nested callbacks, the queue has no slot left\n";
+
+            exit(1);
+        }
+
+        deliver(GL_TRUE);
+    }
+
+    GLuint slot = mFree.back();
+    mFree.pop_back();
+
+    return slot;
+}
+
+GLvoid simgll::ReadbackQueue::submit(GLuint slot, GLsizeiptr size,
+                                     Callback callback)
+{
+    mSlots[slot].fence    = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mSlots[slot].size     = size;
+    mSlots[slot].callback = callback;
+
+    mOrder[(mHead + mCount) % mDepth] = slot;
+    mCount++;
+}
+
+GLvoid simgll::ReadbackQueue::deliver(GLboolean wait)
+{
+    GLuint index = mOrder[mHead];
+    Slot& slot   = mSlots[index];
+
+    if(wait)
+    {
+        GLenum result;
+
+        do
+        {
+            result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                      1000000);
+        } while(result == GL_TIMEOUT_EXPIRED);
+    }
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    Callback callback = std::move(slot.callback);
+    slot.callback     = nullptr;
+
+    mHead = (mHead + 1) % mDepth;
+    mCount--;
+
+    // The slot only returns to the free list once the callback is done
+    // reading it, an enqueue() from the callback takes another one
+    if(callback)
+    {
+        callback(mData + index * mCapacity, slot.size);
+    }
+
+    mFree.push_back(index);
+}
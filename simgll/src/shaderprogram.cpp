@@ -1,7 +1,85 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <random>
 #include "shaderprogram.h"
 
+namespace
+{
+    std::string& cacheDirectory()
+    {
+        static std::string directory = []()
+        {
+            const char* env = std::getenv("SIMGLL_SHADER_CACHE");
+
+            return std::string(env ? env : "");
+        }();
+
+        return directory;
+    }
+
+    GLuint& compilerThreads()
+    {
+        // 0xFFFFFFFF asks for an implementation-specific maximum
+        static GLuint count = 0xFFFFFFFF;
+
+        return count;
+    }
+
+    // 64-bit FNV-1a, good enough to tell shader sources apart
+    std::uint64_t fnv1a(std::uint64_t hash, const void* data, std::size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+        for(std::size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
+        }
+
+        return hash;
+    }
+
+    std::uint64_t fnv1a(std::uint64_t hash, const std::string& s)
+    {
+        // Hash the length too so "ab" + "c" and "a" + "bc" differ
+        std::uint64_t size = s.size();
+        hash = fnv1a(hash, &size, sizeof(size));
+
+        return fnv1a(hash, s.data(), s.size());
+    }
+
+    // Where the header goes: after the line of the #version directive,
+    // which must stay the first one, or at the start without it
+    std::size_t headerPosition(const GLchar* code, std::size_t size)
+    {
+        const std::string version = "#version";
+        const GLchar* directive = std::search(code, code + size, version.begin(),
+                                              version.end());
+
+        if(directive == code + size)
+        {
+            return 0;
+        }
+
+        const GLchar* end = std::find(directive, code + size, '\n');
+
+        return end == code + size ? size : end - code + 1;
+    }
+
+    std::string glString(GLenum name)
+    {
+        const GLubyte* s = glGetString(name);
+
+        return s ? reinterpret_cast<const char*>(s) : "";
+    }
+}
+
 simgll::ShaderProgram::ShaderProgram()
 {
 }
@@ -17,15 +95,9 @@ GLuint simgll::ShaderProgram::name() const
 }
 
 GLvoid simgll::ShaderProgram::addShader(const std::string& filename,
-                                        const GLenum& shaderType)
+                                        const GLenum& shaderType,
+                                        const std::string& header)
 {
-    // Since we don't know when GLEW initialization happens it is better to
-    // create the program the first time addShader() is called
-    if (!mProgramName)
-    {
-        mProgramName = glCreateProgram();
-    }
-
     std::ifstream fs(filename);
 
     if(!fs)
@@ -39,50 +111,206 @@ GLvoid simgll::ShaderProgram::addShader(const std::string& filename,
     code << fs.rdbuf();
     fs.close();
 
-    GLuint shaderObject = glCreateShader(shaderType);
+    addShaderSource(code.str(), shaderType, header);
+}
+
+GLvoid simgll::ShaderProgram::addShaderSource(const std::string& source,
+                                              const GLenum& shaderType,
+                                              const std::string& header)
+{
+    std::string code = source;
 
-    if(shaderObject == 0)
+    if(!header.empty())
     {
-        std::cerr << "Error creating shader type: " << shaderType << std::endl;
+        std::size_t position = headerPosition(code.data(), code.size());
 
-        exit(1);
+        // #version on the last line without a line break
+        if(position == code.size() && position > 0 && code.back() != '\n')
+        {
+            code += '\n';
+            position++;
+        }
+
+        code.insert(position, header.back() == '\n' ? header : header + "\n");
     }
 
-    std::string codeString = code.str();
-    const GLchar* codePtr = codeString.c_str();
+    // Compilation is deferred to compile() so the program binary cache can
+    // be checked before any shader object is created
+    ShaderSource shaderSource;
+    shaderSource.type = shaderType;
+    shaderSource.code = code;
 
-    glShaderSource(shaderObject, 1, &codePtr, nullptr);
-    glCompileShader(shaderObject);
+    mSources.push_back(shaderSource);
+}
 
-    GLint success;
-    GLchar infoLog[512];
+GLvoid simgll::ShaderProgram::addShader(const AssetPack& pack,
+                                        const std::string& name,
+                                        const GLenum& shaderType,
+                                        const std::string& header)
+{
+    GLsizeiptr size;
+    const GLubyte* data = pack.find(name, size);
 
-    glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &success);
-    if(!success)
+    if(!data)
     {
-        glGetShaderInfoLog(shaderObject, 512, nullptr, infoLog);
-
-        std::cerr << "Error compiling shader type: " << shaderType << std::endl;
-        std::cerr << infoLog << std::endl;
+        std::cerr << "Can't find " << name << " in the asset pack" << std::endl;
 
         exit(1);
     }
 
-    mShaderObjects.push_back(shaderObject);
+    ShaderSource shaderSource;
+    shaderSource.type     = shaderType;
+    shaderSource.view     = reinterpret_cast<const GLchar*>(data);
+    shaderSource.viewSize = static_cast<GLint>(size);
+    shaderSource.split    = static_cast<GLint>(headerPosition(shaderSource.view, size));
 
-    glAttachShader(mProgramName, shaderObject);
+    if(!header.empty())
+    {
+        // Same result as addShaderSource() when #version ends the file
+        if(shaderSource.split == size && size > 0 && data[size - 1] != '\n')
+        {
+            shaderSource.code = "\n";
+        }
+
+        shaderSource.code += header.back() == '\n' ? header : header + "\n";
+    }
+
+    mSources.push_back(shaderSource);
 }
 
 GLvoid simgll::ShaderProgram::compile()
 {
+    compileAsync();
+    wait();
+}
+
+GLvoid simgll::ShaderProgram::compileAsync()
+{
+    // Since we don't know when GLEW initialization happens it is better to
+    // create the program the first time compileAsync() is called
+    if (!mProgramName)
+    {
+        mProgramName = glCreateProgram();
+    }
+
+    static GLboolean threadsSet = GL_FALSE;
+
+    if(!threadsSet && GLEW_KHR_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsKHR(compilerThreads());
+        threadsSet = GL_TRUE;
+    }
+
+    mCachePath.clear();
+
+    if(!cacheDirectory().empty())
+    {
+        GLint numFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+
+        if(numFormats > 0)
+        {
+            mCachePath = cacheDirectory() + "/" + cacheKey() + ".bin";
+        }
+    }
+
+    if(!mCachePath.empty() && loadBinary(mCachePath))
+    {
+        mCachePath.clear();
+        mSources.clear();
+
+        reflect();
+
+        return;
+    }
+
+    // Submit every stage before querying any status so the driver can
+    // compile them concurrently
+    for(const auto& source: mSources)
+    {
+        GLuint shaderObject = glCreateShader(source.type);
+
+        if(shaderObject == 0)
+        {
+            std::cerr << "Error creating shader type: " << source.type << std::endl;
+
+            exit(1);
+        }
+
+        const GLchar* strings[3];
+        GLint lengths[3];
+        GLsizei count = source.pieces(strings, lengths);
+
+        glShaderSource(shaderObject, count, strings, lengths);
+        glCompileShader(shaderObject);
+
+        mShaderObjects.push_back(shaderObject);
+
+        glAttachShader(mProgramName, shaderObject);
+    }
+
+    if(!mCachePath.empty())
+    {
+        glProgramParameteri(mProgramName, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                            GL_TRUE);
+    }
+
     glLinkProgram(mProgramName);
 
+    mSources.clear();
+    mPending = GL_TRUE;
+}
+
+GLboolean simgll::ShaderProgram::ready() const
+{
+    if(!mPending)
+    {
+        return GL_TRUE;
+    }
+
+    // Without the extension any status query blocks, so report the program
+    // as ready and let wait() do the blocking
+    if(!GLEW_KHR_parallel_shader_compile)
+    {
+        return GL_TRUE;
+    }
+
+    GLint completed;
+    glGetProgramiv(mProgramName, GL_COMPLETION_STATUS_KHR, &completed);
+
+    return completed ? GL_TRUE : GL_FALSE;
+}
+
+GLvoid simgll::ShaderProgram::wait()
+{
+    if(!mPending)
+    {
+        return;
+    }
+
     GLint success;
     GLchar infoLog[512];
 
     glGetProgramiv(mProgramName, GL_LINK_STATUS, &success);
     if(!success)
     {
+        // Find out whether the link failed because of a compile error
+        for(const auto& shaderObject: mShaderObjects)
+        {
+            glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &success);
+            if(!success)
+            {
+                GLint shaderType;
+                glGetShaderiv(shaderObject, GL_SHADER_TYPE, &shaderType);
+                glGetShaderInfoLog(shaderObject, 512, nullptr, infoLog);
+
+                std::cerr << "Error compiling shader type: " << shaderType << std::endl;
+                std::cerr << infoLog << std::endl;
+
+                exit(1);
+            }
+        }
+
         glGetProgramInfoLog(mProgramName, 512, nullptr, infoLog);
 
         std::cerr << "Link Error: " << infoLog << std::endl;
@@ -96,14 +324,414 @@ GLvoid simgll::ShaderProgram::compile()
     }
 
     mShaderObjects.clear();
+
+    if(!mCachePath.empty())
+    {
+        saveBinary(mCachePath);
+        mCachePath.clear();
+    }
+
+    mPending = GL_FALSE;
+
+    reflect();
+}
+
+GLint simgll::ShaderProgram::getLocation(const std::string& name)
+{
+    wait();
+
+    auto it = mLocations.find(name);
+
+    if(it != mLocations.end())
+    {
+        return it->second;
+    }
+
+    // Individual array elements ("attractor[3]") aren't enumerated, ask the
+    // driver once and remember the answer
+    GLint location = glGetUniformLocation(mProgramName, name.c_str());
+    mLocations[name] = location;
+
+    return location;
 }
 
-GLint simgll::ShaderProgram::getLocation(const std::string& name) const
+GLint simgll::ShaderProgram::getUniformBlockIndex(const std::string& name) const
 {
-    return glGetUniformLocation(mProgramName, name.c_str());
+    auto it = mUniformBlocks.find(name);
+
+    return it != mUniformBlocks.end() ? it->second : -1;
+}
+
+GLint simgll::ShaderProgram::getStorageBlockIndex(const std::string& name) const
+{
+    auto it = mStorageBlocks.find(name);
+
+    return it != mStorageBlocks.end() ? it->second : -1;
 }
 
 GLvoid simgll::ShaderProgram::use()
 {
+    wait();
+
     glUseProgram(mProgramName);
 }
+
+GLvoid simgll::ShaderProgram::set(GLint location, GLfloat value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniform1f(mProgramName, location, value);
+    }
+}
+
+GLvoid simgll::ShaderProgram::set(GLint location, GLint value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniform1i(mProgramName, location, value);
+    }
+}
+
+GLvoid simgll::ShaderProgram::set(GLint location, GLuint value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniform1ui(mProgramName, location, value);
+    }
+}
+
+GLvoid simgll::ShaderProgram::set(GLint location, const glm::vec2& value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniform2fv(mProgramName, location, 1, &value[0]);
+    }
+}
+
+GLvoid simgll::ShaderProgram::set(GLint location, const glm::vec3& value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniform3fv(mProgramName, location, 1, &value[0]);
+    }
+}
+
+GLvoid simgll::ShaderProgram::set(GLint location, const glm::vec4& value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniform4fv(mProgramName, location, 1, &value[0]);
+    }
+}
+
+GLvoid simgll::ShaderProgram::set(GLint location, const glm::ivec2& value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniform2iv(mProgramName, location, 1, &value[0]);
+    }
+}
+
+GLvoid simgll::ShaderProgram::set(GLint location, const glm::uvec2& value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniform2uiv(mProgramName, location, 1, &value[0]);
+    }
+}
+
+GLvoid simgll::ShaderProgram::set(GLint location, const glm::mat3& value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniformMatrix3fv(mProgramName, location, 1, GL_FALSE,
+                                  &value[0][0]);
+    }
+}
+
+GLvoid simgll::ShaderProgram::set(GLint location, const glm::mat4& value)
+{
+    if(changed(location, &value, sizeof(value)))
+    {
+        glProgramUniformMatrix4fv(mProgramName, location, 1, GL_FALSE,
+                                  &value[0][0]);
+    }
+}
+
+GLvoid simgll::ShaderProgram::setHandle(GLint location, GLuint64 handle)
+{
+    if(changed(location, &handle, sizeof(handle)))
+    {
+        glProgramUniformHandleui64ARB(mProgramName, location, handle);
+    }
+}
+
+GLvoid simgll::ShaderProgram::setHandle(const std::string& name, GLuint64 handle)
+{
+    setHandle(getLocation(name), handle);
+}
+
+GLvoid simgll::ShaderProgram::setCacheDirectory(const std::string& directory)
+{
+    cacheDirectory() = directory;
+}
+
+GLvoid simgll::ShaderProgram::setCompilerThreads(GLuint count)
+{
+    compilerThreads() = count;
+
+    if(GLEW_KHR_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsKHR(count);
+    }
+}
+
+GLvoid simgll::ShaderProgram::reflect()
+{
+    mLocations.clear();
+    mUniformBlocks.clear();
+    mStorageBlocks.clear();
+    mValues.clear();
+
+    GLint maxLength = 0, count = 0;
+    std::vector<GLchar> name;
+
+    glGetProgramInterfaceiv(mProgramName, GL_UNIFORM, GL_MAX_NAME_LENGTH,
+                            &maxLength);
+    glGetProgramInterfaceiv(mProgramName, GL_UNIFORM, GL_ACTIVE_RESOURCES,
+                            &count);
+    name.resize(maxLength + 1);
+
+    GLint maxLocation = -1;
+
+    for(GLint i = 0; i < count; i++)
+    {
+        const GLenum property = GL_LOCATION;
+        GLint location;
+
+        glGetProgramResourceiv(mProgramName, GL_UNIFORM, i, 1, &property, 1,
+                               nullptr, &location);
+
+        // Members of uniform blocks have no location
+        if(location < 0)
+        {
+            continue;
+        }
+
+        glGetProgramResourceName(mProgramName, GL_UNIFORM, i,
+                                 static_cast<GLsizei>(name.size()), nullptr,
+                                 name.data());
+
+        std::string uniformName(name.data());
+        mLocations[uniformName] = location;
+
+        // Arrays are reported as "name[0]", make "name" work too
+        std::string::size_type length = uniformName.size();
+
+        if(length > 3 && uniformName.compare(length - 3, 3, "[0]") == 0)
+        {
+            mLocations[uniformName.substr(0, length - 3)] = location;
+        }
+
+        maxLocation = std::max(maxLocation, location);
+    }
+
+    mValues.resize(maxLocation + 1, UniformValue{ 0, {} });
+
+    const std::pair<GLenum, std::unordered_map<std::string, GLint>*> blocks[] =
+    {
+        { GL_UNIFORM_BLOCK,        &mUniformBlocks },
+        { GL_SHADER_STORAGE_BLOCK, &mStorageBlocks }
+    };
+
+    for(const auto& block: blocks)
+    {
+        glGetProgramInterfaceiv(mProgramName, block.first,
+                                GL_MAX_NAME_LENGTH, &maxLength);
+        glGetProgramInterfaceiv(mProgramName, block.first,
+                                GL_ACTIVE_RESOURCES, &count);
+        name.resize(maxLength + 1);
+
+        for(GLint i = 0; i < count; i++)
+        {
+            glGetProgramResourceName(mProgramName, block.first, i,
+                                     static_cast<GLsizei>(name.size()),
+                                     nullptr, name.data());
+
+            (*block.second)[name.data()] = i;
+        }
+    }
+}
+
+GLboolean simgll::ShaderProgram::changed(GLint location, const GLvoid* data,
+                                         GLsizei size)
+{
+    wait();
+
+    if(location < 0)
+    {
+        return GL_FALSE;
+    }
+
+    // Locations obtained by name lookups of array elements may lie past the
+    // enumerated ones
+    if(location >= static_cast<GLint>(mValues.size()))
+    {
+        mValues.resize(location + 1, UniformValue{ 0, {} });
+    }
+
+    UniformValue& cached = mValues[location];
+
+    if(cached.size == size && std::memcmp(cached.data, data, size) == 0)
+    {
+        return GL_FALSE;
+    }
+
+    cached.size = size;
+    std::memcpy(cached.data, data, size);
+
+    return GL_TRUE;
+}
+
+std::string simgll::ShaderProgram::cacheKey() const
+{
+    // Binaries are only valid for the driver that produced them
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = fnv1a(hash, glString(GL_VENDOR));
+    hash = fnv1a(hash, glString(GL_RENDERER));
+    hash = fnv1a(hash, glString(GL_VERSION));
+
+    for(const auto& source: mSources)
+    {
+        const GLchar* strings[3];
+        GLint lengths[3];
+        GLsizei count = source.pieces(strings, lengths);
+
+        // Same key as the whole source in one string
+        std::uint64_t size = 0;
+
+        for(GLsizei i = 0; i < count; i++)
+        {
+            size += lengths[i];
+        }
+
+        hash = fnv1a(hash, &source.type, sizeof(source.type));
+        hash = fnv1a(hash, &size, sizeof(size));
+
+        for(GLsizei i = 0; i < count; i++)
+        {
+            hash = fnv1a(hash, strings[i], lengths[i]);
+        }
+    }
+
+    std::ostringstream key;
+    key << std::hex << std::setw(16) << std::setfill('0') << hash;
+
+    return key.str();
+}
+
+GLboolean simgll::ShaderProgram::loadBinary(const std::string& path)
+{
+    std::ifstream fs(path, std::ios::binary);
+
+    if(!fs)
+    {
+        return GL_FALSE;
+    }
+
+    fs.seekg(0, std::ios::end);
+    std::streamoff size = fs.tellg();
+    fs.seekg(0);
+
+    GLenum format;
+
+    if(size <= static_cast<std::streamoff>(sizeof(format)))
+    {
+        return GL_FALSE;
+    }
+
+    std::vector<char> binary(static_cast<std::size_t>(size) - sizeof(format));
+
+    fs.read(reinterpret_cast<char*>(&format), sizeof(format));
+    fs.read(binary.data(), binary.size());
+
+    if(!fs)
+    {
+        return GL_FALSE;
+    }
+
+    glProgramBinary(mProgramName, format, binary.data(),
+                    static_cast<GLsizei>(binary.size()));
+
+    // The driver is free to reject a binary (e.g. after an update), in that
+    // case the program is built from source again
+    GLint success;
+    glGetProgramiv(mProgramName, GL_LINK_STATUS, &success);
+
+    return success ? GL_TRUE : GL_FALSE;
+}
+
+GLvoid simgll::ShaderProgram::saveBinary(const std::string& path) const
+{
+    GLint length = 0;
+    glGetProgramiv(mProgramName, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if(length <= 0)
+    {
+        return;
+    }
+
+    GLenum format;
+    std::vector<char> binary(length);
+    glGetProgramBinary(mProgramName, length, nullptr, &format, binary.data());
+
+    // Write to a temporary file and rename it so concurrent processes never
+    // read a partially written binary
+    std::random_device rd;
+    std::string tempPath = path + "." + std::to_string(rd()) + ".tmp";
+
+    std::ofstream fs(tempPath, std::ios::binary);
+
+    if(!fs)
+    {
+        return;
+    }
+
+    fs.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    fs.write(binary.data(), binary.size());
+    fs.close();
+
+#ifdef _WIN32
+    // rename() doesn't replace an existing file on Windows
+    if(fs)
+    {
+        std::remove(path.c_str());
+    }
+#endif
+
+    if(!fs || std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tempPath.c_str());
+    }
+}
+
+GLsizei simgll::ShaderProgram::ShaderSource::pieces(const GLchar* strings[3],
+                                                    GLint lengths[3]) const
+{
+    if(!view)
+    {
+        strings[0] = code.data();
+        lengths[0] = static_cast<GLint>(code.size());
+
+        return 1;
+    }
+
+    strings[0] = view;
+    lengths[0] = split;
+    strings[1] = code.data();
+    lengths[1] = static_cast<GLint>(code.size());
+    strings[2] = view + split;
+    lengths[2] = viewSize - split;
+
+    return 3;
+}
@@ -1,57 +1,1403 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include "texture.h"
 
 using std::cout;
 
-GLuint simgll::createTextureObject(const char* filename)
+namespace
 {
-    FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filename, 0);
+    const GLubyte KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1',
+                                         0xBB, '\r', '\n', 0x1A, '\n' };
+    const GLuint     KTX_ENDIANNESS  = 0x04030201;
+    const GLsizeiptr KTX_HEADER_SIZE = 64;
+    const char       KTX_SWIZZLE_KEY[] = "KTXswizzle";
+
+    // Magic number and DDS_HEADER, followed by DDS_HEADER_DXT10 when the
+    // four character code is DX10
+    const GLsizeiptr DDS_HEADER_SIZE  = 128;
+    const GLsizeiptr DDS_DX10_SIZE    = 20;
+    const GLuint     DDSD_MIPMAPCOUNT = 0x20000;
+    const GLuint     DDPF_FOURCC      = 0x4;
+    const GLuint     DDSCAPS2_CUBEMAP = 0x200;
+    const GLuint     DDSCAPS2_VOLUME  = 0x200000;
+    const GLuint     DDS_DIMENSION_2D = 3;
+    const GLuint     DDS_MISC_CUBE    = 0x4;
 
-    if (format == FIF_UNKNOWN)
+    // Largest side accepted from image files. Images may be read without a
+    // GL context, GL_MAX_TEXTURE_SIZE is checked by supported() before the
+    // texture is created.
+    const GLuint MAX_IMAGE_SIZE = 1 << 16;
+
+    GLuint fourCC(const char* code)
     {
-        cout << "Unknown image format" << filename << std::endl;
+        return static_cast<GLuint>(code[0])       |
+               static_cast<GLuint>(code[1]) << 8  |
+               static_cast<GLuint>(code[2]) << 16 |
+               static_cast<GLuint>(code[3]) << 24;
+    }
 
-        exit(1);
+    // Little endian word of a file
+    GLuint readWord(const GLubyte* data, GLsizeiptr offset)
+    {
+        GLuint word;
+        std::memcpy(&word, data + offset, sizeof(word));
+
+        return word;
     }
 
-    FIBITMAP* bitmap = FreeImage_Load(format, filename);
+    // Bytes of a 4x4 block of a compressed format, 0 for unknown formats
+    GLsizeiptr blockSize(GLenum internalFormat)
+    {
+        switch(internalFormat)
+        {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RED_RGTC1:
+            case GL_COMPRESSED_SIGNED_RED_RGTC1:
+            case GL_COMPRESSED_RGB8_ETC2:
+            case GL_COMPRESSED_SRGB8_ETC2:
+            case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+            case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+            case GL_COMPRESSED_R11_EAC:
+            case GL_COMPRESSED_SIGNED_R11_EAC:
+                return 8;
+
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_RG_RGTC2:
+            case GL_COMPRESSED_SIGNED_RG_RGTC2:
+            case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+            case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+            case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+            case GL_COMPRESSED_RGBA8_ETC2_EAC:
+            case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+            case GL_COMPRESSED_RG11_EAC:
+            case GL_COMPRESSED_SIGNED_RG11_EAC:
+                return 16;
 
-    int bitsPerPixel = FreeImage_GetBPP(bitmap);
+            default:
+                return 0;
+        }
+    }
 
-    FIBITMAP* bitmap32;
-    if (bitsPerPixel == 32)
+    // Compressed format of a legacy DDS four character code
+    GLenum fourCCFormat(GLuint code)
     {
-        cout << "Source image has " << bitsPerPixel << " bits per pixel." << std::endl;
+        if(code == fourCC("DXT1")) return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        if(code == fourCC("DXT3")) return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        if(code == fourCC("DXT5")) return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        if(code == fourCC("ATI1")) return GL_COMPRESSED_RED_RGTC1;
+        if(code == fourCC("BC4U")) return GL_COMPRESSED_RED_RGTC1;
+        if(code == fourCC("BC4S")) return GL_COMPRESSED_SIGNED_RED_RGTC1;
+        if(code == fourCC("ATI2")) return GL_COMPRESSED_RG_RGTC2;
+        if(code == fourCC("BC5U")) return GL_COMPRESSED_RG_RGTC2;
+        if(code == fourCC("BC5S")) return GL_COMPRESSED_SIGNED_RG_RGTC2;
 
-        bitmap32 = bitmap;
+        return GL_NONE;
     }
-    else
+
+    // Formats of the DXGI_FORMAT of a DX10 header, only the block
+    // compressed ones and a few 8-bit ones
+    GLboolean dxgiFormat(GLuint dxgi, simgll::Image& image)
     {
-        cout << "Source image has " << bitsPerPixel << " bits per pixel." << std::endl;
+        struct Format
+        {
+            GLuint dxgi;
+            GLenum internalFormat;
+            GLenum format;
+        };
+
+        static const Format formats[] =
+        {
+            { 28, GL_RGBA8,                                 GL_RGBA },
+            { 29, GL_SRGB8_ALPHA8,                          GL_RGBA },
+            { 49, GL_RG8,                                   GL_RG   },
+            { 61, GL_R8,                                    GL_RED  },
+            { 71, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,         GL_NONE },
+            { 72, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT,   GL_NONE },
+            { 74, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,         GL_NONE },
+            { 75, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT,   GL_NONE },
+            { 77, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,         GL_NONE },
+            { 78, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,   GL_NONE },
+            { 80, GL_COMPRESSED_RED_RGTC1,                  GL_NONE },
+            { 81, GL_COMPRESSED_SIGNED_RED_RGTC1,           GL_NONE },
+            { 83, GL_COMPRESSED_RG_RGTC2,                   GL_NONE },
+            { 84, GL_COMPRESSED_SIGNED_RG_RGTC2,            GL_NONE },
+            { 87, GL_RGBA8,                                 GL_BGRA },
+            { 95, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT,    GL_NONE },
+            { 96, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT,      GL_NONE },
+            { 98, GL_COMPRESSED_RGBA_BPTC_UNORM,            GL_NONE },
+            { 99, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,      GL_NONE }
+        };
+
+        for(const Format& format : formats)
+        {
+            if(format.dxgi == dxgi)
+            {
+                image.internalFormat = format.internalFormat;
+                image.format         = format.format;
+                image.compressed     = format.format == GL_NONE;
+
+                return GL_TRUE;
+            }
+        }
+
+        return GL_FALSE;
+    }
+
+    // Base internal format written in KTX headers
+    GLenum baseFormat(const simgll::Image& image)
+    {
+        GLenum format = image.format;
+
+        if(image.compressed)
+        {
+            switch(image.internalFormat)
+            {
+                case GL_COMPRESSED_RED_RGTC1:
+                case GL_COMPRESSED_SIGNED_RED_RGTC1:
+                case GL_COMPRESSED_R11_EAC:
+                case GL_COMPRESSED_SIGNED_R11_EAC:
+                    return GL_RED;
+
+                case GL_COMPRESSED_RG_RGTC2:
+                case GL_COMPRESSED_SIGNED_RG_RGTC2:
+                case GL_COMPRESSED_RG11_EAC:
+                case GL_COMPRESSED_SIGNED_RG11_EAC:
+                    return GL_RG;
+
+                case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+                case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+                case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+                case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+                case GL_COMPRESSED_RGB8_ETC2:
+                case GL_COMPRESSED_SRGB8_ETC2:
+                    return GL_RGB;
+
+                default:
+                    return GL_RGBA;
+            }
+        }
+
+        switch(format)
+        {
+            case GL_BGR:  return GL_RGB;
+            case GL_BGRA: return GL_RGBA;
+            default:      return format;
+        }
+    }
+
+    GLsizeiptr components(GLenum format)
+    {
+        switch(format)
+        {
+            case GL_RED:
+            case GL_RED_INTEGER: return 1;
+            case GL_RG:
+            case GL_RG_INTEGER:  return 2;
+            case GL_RGB:
+            case GL_BGR:
+            case GL_RGB_INTEGER:
+            case GL_BGR_INTEGER: return 3;
+            default:             return 4;
+        }
+    }
+
+    // Bytes per pixel of plain formats, 0 for unknown types
+    GLsizeiptr pixelSize(GLenum format, GLenum type)
+    {
+        switch(type)
+        {
+            case GL_UNSIGNED_BYTE:
+            case GL_BYTE:                         return components(format);
+            case GL_UNSIGNED_SHORT:
+            case GL_SHORT:
+            case GL_HALF_FLOAT:                   return 2 * components(format);
+            case GL_UNSIGNED_INT:
+            case GL_INT:
+            case GL_FLOAT:                        return 4 * components(format);
+            case GL_UNSIGNED_SHORT_5_6_5:
+            case GL_UNSIGNED_SHORT_4_4_4_4:
+            case GL_UNSIGNED_SHORT_5_5_5_1:       return 2;
+            case GL_UNSIGNED_INT_8_8_8_8:
+            case GL_UNSIGNED_INT_8_8_8_8_REV:
+            case GL_UNSIGNED_INT_2_10_10_10_REV:
+            case GL_UNSIGNED_INT_10F_11F_11F_REV:
+            case GL_UNSIGNED_INT_5_9_9_9_REV:     return 4;
+            default:                              return 0;
+        }
+    }
+
+    // Whether the size and number of levels of an image can be used as they
+    // are, so levels are never shifted past the size of the image
+    GLboolean validSize(GLuint width, GLuint height, GLuint levels)
+    {
+        if(width == 0 || height == 0 || width > MAX_IMAGE_SIZE ||
+           height > MAX_IMAGE_SIZE)
+        {
+            return GL_FALSE;
+        }
+
+        GLuint maxLevels = 1;
+
+        for(GLuint size = std::max(width, height); size > 1; size >>= 1)
+        {
+            maxLevels++;
+        }
+
+        return levels <= maxLevels;
+    }
+
+    // Rows of plain formats are padded to the alignment of the image
+    simgll::Image::Level levelSize(const simgll::Image& image, GLsizei width,
+                                   GLsizei height, GLuint level)
+    {
+        simgll::Image::Level size;
+        size.width  = std::max(width  >> level, 1);
+        size.height = std::max(height >> level, 1);
+        size.offset = 0;
+
+        if(image.compressed)
+        {
+            size.rows    = (size.height + 3) / 4;
+            size.rowSize = (size.width  + 3) / 4 * blockSize(image.internalFormat);
+        }
+        else
+        {
+            GLsizeiptr row = size.width * pixelSize(image.format, image.type);
+
+            size.rows    = size.height;
+            size.rowSize = (row + image.alignment - 1) / image.alignment *
+                           image.alignment;
+        }
+
+        return size;
+    }
+
+    GLboolean readKtx(const GLubyte* data, GLsizeiptr size,
+                      const std::string& filename, simgll::Image& image,
+                      std::string& error)
+    {
+        if(size < KTX_HEADER_SIZE)
+        {
+            error = "Truncated KTX file " + filename;
+
+            return GL_FALSE;
+        }
+
+        if(readWord(data, 12) != KTX_ENDIANNESS)
+        {
+            error = "Big endian KTX file " + filename + " isn't supported";
+
+            return GL_FALSE;
+        }
+
+        GLuint type           = readWord(data, 16);
+        GLuint format         = readWord(data, 24);
+        GLuint internalFormat = readWord(data, 28);
+        GLuint width          = readWord(data, 36);
+        GLuint height         = readWord(data, 40);
+        GLuint depth          = readWord(data, 44);
+        GLuint elements       = readWord(data, 48);
+        GLuint faces          = readWord(data, 52);
+        GLuint levels         = std::max(readWord(data, 56), 1U);
+        GLuint keyValueSize   = readWord(data, 60);
+
+        if(width == 0 || height == 0 || depth != 0 || elements != 0 || faces != 1)
+        {
+            error = "KTX file " + filename + " isn't a 2D texture";
+
+            return GL_FALSE;
+        }
+
+        if(!validSize(width, height, levels))
+        {
+            error = "Invalid size or number of levels in " + filename;
+
+            return GL_FALSE;
+        }
+
+        image.internalFormat = internalFormat;
+        image.compressed     = type == 0;
+
+        if(image.compressed)
+        {
+            if(blockSize(internalFormat) == 0)
+            {
+                error = "Unsupported compressed format in " + filename;
+
+                return GL_FALSE;
+            }
+        }
+        else
+        {
+            image.format = format;
+            image.type   = type;
+
+            if(pixelSize(format, type) == 0)
+            {
+                error = "Unsupported pixel type in " + filename;
+
+                return GL_FALSE;
+            }
+        }
+
+        GLsizeiptr offset = KTX_HEADER_SIZE + keyValueSize;
+
+        if(offset > size)
+        {
+            error = "Truncated KTX file " + filename;
+
+            return GL_FALSE;
+        }
+
+        // Grey images are single channel textures swizzled to rrr1
+        for(GLsizeiptr pair = KTX_HEADER_SIZE; pair + 4 <= offset; )
+        {
+            GLsizeiptr pairSize = readWord(data, pair);
+            const char* key     = reinterpret_cast<const char*>(data + pair + 4);
+
+            if(pairSize >= static_cast<GLsizeiptr>(sizeof(KTX_SWIZZLE_KEY)) + 4 &&
+               pair + 4 + pairSize <= offset &&
+               std::memcmp(key, KTX_SWIZZLE_KEY, sizeof(KTX_SWIZZLE_KEY)) == 0)
+            {
+                image.luminance = std::memcmp(key + sizeof(KTX_SWIZZLE_KEY),
+                                              "rrr1", 4) == 0;
+            }
+
+            pair += 4 + (pairSize + 3) / 4 * 4;
+        }
+
+        for(GLuint level = 0; level < levels; level++)
+        {
+            if(offset + 4 > size)
+            {
+                error = "Truncated KTX file " + filename;
+
+                return GL_FALSE;
+            }
+
+            GLsizeiptr imageSize = readWord(data, offset);
+            offset += 4;
+
+            // Rows of plain formats are padded to 4 bytes, the default
+            // alignment of images
+            simgll::Image::Level levelInfo = levelSize(image, width, height, level);
+            levelInfo.offset = offset;
+
+            if(levelInfo.rows * levelInfo.rowSize > imageSize ||
+               offset + imageSize > size)
+            {
+                error = "Truncated KTX file " + filename;
+
+                return GL_FALSE;
+            }
+
+            image.levels.push_back(levelInfo);
+
+            offset += (imageSize + 3) / 4 * 4;
+        }
+
+        return GL_TRUE;
+    }
+
+    GLboolean readDds(const GLubyte* data, GLsizeiptr size,
+                      const std::string& filename, simgll::Image& image,
+                      std::string& error)
+    {
+
+        if(size < DDS_HEADER_SIZE)
+        {
+            error = "Truncated DDS file " + filename;
+
+            return GL_FALSE;
+        }
+
+        GLuint flags       = readWord(data, 8);
+        GLuint height      = readWord(data, 12);
+        GLuint width       = readWord(data, 16);
+        GLuint levels      = readWord(data, 28);
+        GLuint formatFlags = readWord(data, 80);
+        GLuint code        = readWord(data, 84);
+        GLuint caps2       = readWord(data, 112);
+
+        if(width == 0 || height == 0 ||
+           (caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)))
+        {
+            error = "DDS file " + filename + " isn't a 2D texture";
+
+            return GL_FALSE;
+        }
+
+        if(!(flags & DDSD_MIPMAPCOUNT))
+        {
+            levels = 1;
+        }
+
+        levels = std::max(levels, 1U);
+
+        if(!validSize(width, height, levels))
+        {
+            error = "Invalid size or number of levels in " + filename;
+
+            return GL_FALSE;
+        }
+
+        if(!(formatFlags & DDPF_FOURCC))
+        {
+            error = "Unsupported pixel format in " + filename;
+
+            return GL_FALSE;
+        }
+
+        GLsizeiptr offset = DDS_HEADER_SIZE;
+
+        if(code == fourCC("DX10"))
+        {
+            if(size < DDS_HEADER_SIZE + DDS_DX10_SIZE)
+            {
+                error = "Truncated DDS file " + filename;
+
+                return GL_FALSE;
+            }
+
+            // Cube maps are 2D resources flagged in miscFlag, arrays of
+            // them store the number of cubes
+            if(readWord(data, 132) != DDS_DIMENSION_2D ||
+               (readWord(data, 136) & DDS_MISC_CUBE) || readWord(data, 140) > 1)
+            {
+                error = "DDS file " + filename + " isn't a 2D texture";
+
+                return GL_FALSE;
+            }
+
+            if(!dxgiFormat(readWord(data, 128), image))
+            {
+                error = "Unsupported DXGI format in " + filename;
+
+                return GL_FALSE;
+            }
+
+            offset += DDS_DX10_SIZE;
+        }
+        else
+        {
+            image.internalFormat = fourCCFormat(code);
+            image.compressed     = GL_TRUE;
+
+            if(image.internalFormat == GL_NONE)
+            {
+                error = "Unsupported compressed format in " + filename;
+
+                return GL_FALSE;
+            }
+        }
+
+        // DDS rows are tightly packed
+        image.alignment = 1;
+
+        for(GLuint level = 0; level < levels; level++)
+        {
+            simgll::Image::Level levelInfo = levelSize(image, width, height, level);
+            levelInfo.offset = offset;
+
+            offset += levelInfo.rows * levelInfo.rowSize;
+
+            if(offset > size)
+            {
+                error = "Truncated DDS file " + filename;
+
+                return GL_FALSE;
+            }
+
+            image.levels.push_back(levelInfo);
+        }
+
+        return GL_TRUE;
+    }
+
+    enum class Container
+    {
+        None,
+        Ktx,
+        Dds
+    };
+
+    Container container(const GLubyte* data, GLsizeiptr size)
+    {
+        if(size >= static_cast<GLsizeiptr>(sizeof(KTX_IDENTIFIER)) &&
+           std::memcmp(data, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0)
+        {
+            return Container::Ktx;
+        }
+
+        if(size >= 4 && std::memcmp(data, "DDS ", 4) == 0)
+        {
+            return Container::Dds;
+        }
+
+        return Container::None;
+    }
+
+    // Reads a KTX or DDS file in memory, the levels point into it
+    GLboolean readContainer(const GLubyte* data, GLsizeiptr size,
+                            const std::string& filename, simgll::Image& image,
+                            std::string& error)
+    {
+        image.pixels = data;
+
+        switch(container(data, size))
+        {
+            case Container::Ktx:
+                return readKtx(data, size, filename, image, error);
+
+            case Container::Dds:
+                return readDds(data, size, filename, image, error);
+
+            default:
+                error = filename + " isn't a KTX or DDS image";
+
+                return GL_FALSE;
+        }
+    }
+
+    // Decodes any other format with FreeImage, keeping 8-bit grey, 24 and
+    // 32-bit bitmaps as they are
+    GLboolean readBitmap(const std::string& filename, simgll::Image& image,
+                         std::string& error)
+    {
+        FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filename.c_str(), 0);
+
+        if(format == FIF_UNKNOWN)
+        {
+            error = "Unknown image format " + filename;
+
+            return GL_FALSE;
+        }
+
+        FIBITMAP* bitmap = FreeImage_Load(format, filename.c_str());
+
+        if(!bitmap)
+        {
+            error = "Can't read image " + filename;
+
+            return GL_FALSE;
+        }
+
+        GLuint    bitsPerPixel = FreeImage_GetBPP(bitmap);
+        GLboolean plain        = FreeImage_GetImageType(bitmap) == FIT_BITMAP;
+
+        if(plain && bitsPerPixel == 8 &&
+           FreeImage_GetColorType(bitmap) == FIC_MINISBLACK)
+        {
+            image.internalFormat = GL_R8;
+            image.format         = GL_RED;
+            image.luminance      = GL_TRUE;
+        }
+        else if(plain && bitsPerPixel == 24)
+        {
+            image.internalFormat = GL_RGB8;
+            image.format         = GL_BGR;
+        }
+        else if(!plain || bitsPerPixel != 32)
+        {
+            FIBITMAP* bitmap32 = FreeImage_ConvertTo32Bits(bitmap);
+            FreeImage_Unload(bitmap);
+
+            if(!bitmap32)
+            {
+                error = "Can't convert image " + filename + " to 32 bits per pixel";
+
+                return GL_FALSE;
+            }
+
+            bitmap = bitmap32;
+        }
+
+        // FreeImage rows are bottom up like GL expects them, and padded to
+        // 4 bytes like the default unpack alignment
+        simgll::Image::Level level;
+        level.width   = FreeImage_GetWidth(bitmap);
+        level.height  = FreeImage_GetHeight(bitmap);
+        level.rows    = level.height;
+        level.rowSize = FreeImage_GetPitch(bitmap);
+        level.offset  = 0;
+
+        const GLubyte* bits = FreeImage_GetBits(bitmap);
+
+        image.levels.push_back(level);
+        image.data.assign(bits, bits + level.rows * level.rowSize);
 
-        bitmap32 = FreeImage_ConvertTo32Bits(bitmap);
         FreeImage_Unload(bitmap);
+
+        return GL_TRUE;
+    }
+
+    // A single plain level is completed with generated mipmaps, compressed
+    // images keep the levels of their file
+    GLboolean generatesMipmaps(const simgll::Image& image)
+    {
+        return image.levels.size() == 1 && !image.compressed;
+    }
+
+    // Whether the driver can create a texture for the image
+    GLboolean supported(const simgll::Image& image, const std::string& filename,
+                        std::string& error)
+    {
+        GLint maxSize, result = GL_FALSE;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        glGetInternalformativ(GL_TEXTURE_2D, image.internalFormat,
+                              GL_INTERNALFORMAT_SUPPORTED, 1, &result);
+
+        if(result != GL_TRUE)
+        {
+            error = "Texture format of " + filename + " isn't supported";
+
+            return GL_FALSE;
+        }
+
+        if(image.levels[0].width > maxSize || image.levels[0].height > maxSize)
+        {
+            error = "Image " + filename + " exceeds the maximum texture size";
+
+            return GL_FALSE;
+        }
+
+        return GL_TRUE;
+    }
+
+    // Creates the immutable storage of the image and leaves it bound
+    GLuint createStorage(const simgll::Image& image)
+    {
+        const simgll::Image::Level& base = image.levels[0];
+
+        GLsizei levels = static_cast<GLsizei>(image.levels.size());
+
+        if(generatesMipmaps(image))
+        {
+            for(GLsizei size = std::max(base.width, base.height); size > 1; size >>= 1)
+            {
+                levels++;
+            }
+        }
+
+        GLuint texture;
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        glTexStorage2D(GL_TEXTURE_2D, levels, image.internalFormat, base.width,
+                       base.height);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        if(image.luminance)
+        {
+            const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+
+        return texture;
     }
 
-    GLuint texture;
+    // Uploads count rows of a level of the bound texture starting at row
+    // first, pixels is an offset when a pixel unpack buffer is bound
+    GLvoid uploadRows(const simgll::Image& image, GLuint level, GLsizei first,
+                      GLsizei count, const GLvoid* pixels)
+    {
+        const simgll::Image::Level& size = image.levels[level];
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, image.alignment);
+
+        if(image.compressed)
+        {
+            // Whole blocks, the last row may stop at the edge of the level
+            GLsizei y      = first * 4;
+            GLsizei height = std::min(count * 4, size.height - y);
+
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, size.width,
+                                      height, image.internalFormat,
+                                      static_cast<GLsizei>(count * size.rowSize),
+                                      pixels);
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, first, size.width, count,
+                            image.format, image.type, pixels);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    GLuint createTexture(const simgll::Image& image)
+    {
+        GLuint texture = createStorage(image);
+
+        for(GLuint level = 0; level < image.levels.size(); level++)
+        {
+            uploadRows(image, level, 0, image.levels[level].rows,
+                       image.pixels + image.levels[level].offset);
+        }
+
+        if(generatesMipmaps(image))
+        {
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        return texture;
+    }
+}
+
+GLboolean simgll::readImage(const std::string& filename, Image& image,
+                            std::string& error)
+{
+    image = Image();
+
+    std::ifstream file(filename, std::ios::binary);
+
+    if(!file)
+    {
+        error = "Can't open image " + filename;
+
+        return GL_FALSE;
+    }
+
+    GLubyte magic[sizeof(KTX_IDENTIFIER)] = {};
+    file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+
+    if(container(magic, file.gcount()) == Container::None)
+    {
+        GLboolean result = readBitmap(filename, image, error);
+        image.pixels = image.data.data();
+
+        return result;
+    }
 
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    // KTX and DDS levels are uploaded as they are, they point into the
+    // whole file
+    file.clear();
+    file.seekg(0, std::ios::end);
+    image.data.resize(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(image.data.data()), image.data.size());
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    return readContainer(image.data.data(), image.data.size(), filename, image,
+                         error);
+}
+
+GLboolean simgll::readImage(const GLubyte* data, GLsizeiptr size,
+                            const std::string& name, Image& image,
+                            std::string& error)
+{
+    image = Image();
+
+    return readContainer(data, size, name, image, error);
+}
+
+std::vector<GLubyte> simgll::writeKtx(const Image& image)
+{
+    std::vector<GLubyte> file(KTX_IDENTIFIER, KTX_IDENTIFIER + sizeof(KTX_IDENTIFIER));
+
+    auto word = [&file](GLuint value)
+    {
+        const GLubyte* bytes = reinterpret_cast<const GLubyte*>(&value);
+        file.insert(file.end(), bytes, bytes + sizeof(value));
+    };
+
+    // The swizzle key and its value, padded to 4 bytes
+    const GLubyte swizzle[] = { 'K', 'T', 'X', 's', 'w', 'i', 'z', 'z', 'l', 'e', 0,
+                                'r', 'r', 'r', '1', 0 };
+    GLuint keyValueSize = image.luminance ? 4 + sizeof(swizzle) : 0;
+
+    word(KTX_ENDIANNESS);
+    word(image.compressed ? 0 : image.type);
+    word(1);
+    word(image.compressed ? 0 : image.format);
+    word(image.internalFormat);
+    word(baseFormat(image));
+    word(image.levels[0].width);
+    word(image.levels[0].height);
+    word(0);
+    word(0);
+    word(1);
+    word(static_cast<GLuint>(image.levels.size()));
+    word(keyValueSize);
+
+    if(image.luminance)
+    {
+        word(sizeof(swizzle));
+        file.insert(file.end(), swizzle, swizzle + sizeof(swizzle));
+    }
+
+    for(const Image::Level& level : image.levels)
+    {
+        // KTX rows are padded to 4 bytes, which also pads the level
+        GLsizeiptr rowSize = image.compressed ? level.rowSize
+                                              : (level.rowSize + 3) / 4 * 4;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        word(static_cast<GLuint>(level.rows * rowSize));
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, FreeImage_GetWidth(bitmap32), FreeImage_GetHeight(bitmap32), 0,
-                 GL_BGRA, GL_UNSIGNED_BYTE, FreeImage_GetBits(bitmap32));
+        for(GLsizei row = 0; row < level.rows; row++)
+        {
+            const GLubyte* source = image.pixels + level.offset + row * level.rowSize;
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+            file.insert(file.end(), source, source + level.rowSize);
+            file.resize(file.size() + rowSize - level.rowSize, 0);
+        }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+        file.resize((file.size() + 3) / 4 * 4, 0);
+    }
 
-    FreeImage_Unload(bitmap32);
+    return file;
+}
+
+GLuint simgll::createTextureObject(const char* filename, std::string& error)
+{
+    Image image;
+
+    if(!readImage(filename, image, error) || !supported(image, filename, error))
+    {
+        return 0;
+    }
+
+    return createTexture(image);
+}
+
+GLuint simgll::createTextureObject(const AssetPack& pack, const std::string& name,
+                                   std::string& error)
+{
+    Image image;
+
+    GLsizeiptr size;
+    const GLubyte* data = pack.find(name, size);
+
+    if(!data)
+    {
+        error = "Can't find " + name + " in the asset pack";
+
+        return 0;
+    }
+
+    if(!readImage(data, size, name, image, error) ||
+       !supported(image, name, error))
+    {
+        return 0;
+    }
+
+    // Uploaded straight from the mapping of the pack
+    return createTexture(image);
+}
+
+GLuint simgll::createTextureObject(const char* filename)
+{
+    std::string error;
+    GLuint texture = createTextureObject(filename, error);
+
+    if(texture == 0)
+    {
+        cout << error << std::endl;
+
+        exit(1);
+    }
+
+    return texture;
+}
+
+GLuint simgll::createTextureObject(const AssetPack& pack, const std::string& name)
+{
+    std::string error;
+    GLuint texture = createTextureObject(pack, name, error);
+
+    if(texture == 0)
+    {
+        cout << error << std::endl;
+
+        exit(1);
+    }
 
     return texture;
 }
+
+simgll::TextureArray::TextureArray(GLenum internalFormat, GLsizei width,
+                                   GLsizei height, GLsizei layers,
+                                   GLsizei levels) :
+    mInternalFormat(internalFormat),
+    mWidth(width),
+    mHeight(height),
+    mLayers(layers),
+    mLevels(levels)
+{
+    if(mLevels == 0)
+    {
+        mLevels = 1;
+
+        for(GLsizei size = std::max(width, height); size > 1; size >>= 1)
+        {
+            mLevels++;
+        }
+    }
+
+    glGenTextures(1, &mName);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mName);
+
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, mLevels, mInternalFormat, mWidth,
+                   mHeight, mLayers);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    mLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+simgll::TextureArray::~TextureArray()
+{
+    if(mHandle)
+    {
+        glMakeTextureHandleNonResidentARB(mHandle);
+    }
+
+    glDeleteTextures(1, &mName);
+}
+
+GLuint simgll::TextureArray::name() const
+{
+    return mName;
+}
+
+GLsizei simgll::TextureArray::layers() const
+{
+    return mLayers;
+}
+
+GLvoid simgll::TextureArray::setLayer(GLint layer, GLenum format, GLenum type,
+                                      const GLvoid* pixels)
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mName);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, mWidth, mHeight, 1,
+                    format, type, pixels);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+GLboolean simgll::TextureArray::setLayer(GLint layer, const Image& image,
+                                         std::string& error)
+{
+    if(image.internalFormat != mInternalFormat ||
+       image.levels[0].width != mWidth || image.levels[0].height != mHeight)
+    {
+        error = "Image doesn't match the size or format of the texture array";
+
+        return GL_FALSE;
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mName);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, image.alignment);
+
+    GLsizei levels = std::min(static_cast<GLsizei>(image.levels.size()), mLevels);
+
+    for(GLsizei i = 0; i < levels; i++)
+    {
+        const Image::Level& level = image.levels[i];
+        const GLubyte* pixels     = image.pixels + level.offset;
+
+        if(image.compressed)
+        {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer,
+                                      level.width, level.height, 1,
+                                      mInternalFormat,
+                                      static_cast<GLsizei>(level.rows * level.rowSize),
+                                      pixels);
+        }
+        else
+        {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width,
+                            level.height, 1, image.format, image.type, pixels);
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    return GL_TRUE;
+}
+
+GLvoid simgll::TextureArray::generateMipmaps()
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mName);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+GLvoid simgll::TextureArray::bind(GLuint unit) const
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mName);
+}
+
+GLuint64 simgll::TextureArray::handle()
+{
+    if(!mHandle)
+    {
+        mHandle = glGetTextureHandleARB(mName);
+        glMakeTextureHandleResidentARB(mHandle);
+    }
+
+    return mHandle;
+}
+
+GLboolean simgll::bindlessSupported()
+{
+    return GLEW_ARB_bindless_texture ? GL_TRUE : GL_FALSE;
+}
+
+std::string simgll::bindlessGlsl()
+{
+    if(!bindlessSupported())
+    {
+        return "";
+    }
+
+    return "#extension GL_ARB_bindless_texture : require\n"
+           "#define SIMGLL_BINDLESS 1\n";
+}
+
+simgll::TextureLoader::TextureLoader(GLuint threads, GLsizeiptr sliceSize) :
+    mStaging(sliceSize)
+{
+    if(threads == 0)
+    {
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    for(GLuint i = 0; i < threads; i++)
+    {
+        mThreads.emplace_back(&TextureLoader::worker, this);
+    }
+}
+
+simgll::TextureLoader::~TextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = GL_TRUE;
+    }
+
+    mWake.notify_all();
+
+    for(std::thread& thread : mThreads)
+    {
+        thread.join();
+    }
+
+    // Only the textures still being uploaded are the loader's
+    for(auto& entry : mEntries)
+    {
+        if(entry->status == Status::Pending)
+        {
+            glDeleteTextures(1, &entry->texture);
+        }
+    }
+}
+
+simgll::TextureLoader::Handle
+simgll::TextureLoader::load(const std::string& filename)
+{
+    std::unique_ptr<Entry> entry(new Entry);
+    entry->filename = filename;
+
+    return queue(std::move(entry));
+}
+
+simgll::TextureLoader::Handle
+simgll::TextureLoader::load(const AssetPack& pack, const std::string& name)
+{
+    std::unique_ptr<Entry> entry(new Entry);
+    entry->filename = name;
+    entry->pack     = &pack;
+
+    return queue(std::move(entry));
+}
+
+simgll::TextureLoader::Handle
+simgll::TextureLoader::queue(std::unique_ptr<Entry> entry)
+{
+    Handle handle;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        handle = static_cast<Handle>(mEntries.size());
+        mEntries.push_back(std::move(entry));
+        mRequests.push_back(handle);
+    }
+
+    mPending++;
+    mWake.notify_one();
+
+    return handle;
+}
+
+GLuint simgll::TextureLoader::update()
+{
+    GLuint pending = mPending;
+
+    GLubyte*   staging = nullptr;
+    GLsizeiptr used    = 0;
+
+    while(nextUpload())
+    {
+        Entry& entry = *mUpload;
+        const Image& image = *entry.image;
+        const Image::Level& level = image.levels[entry.level];
+
+        // Whole rows only, the rest of the image waits for the next call
+        GLsizei rows = static_cast<GLsizei>(std::min<GLsizeiptr>(
+            level.rows - entry.row,
+            (mStaging.regionSize() - used) / level.rowSize));
+
+        if(rows == 0)
+        {
+            break;
+        }
+
+        if(!staging)
+        {
+            staging = mStaging.begin<GLubyte>();
+        }
+
+        std::memcpy(staging + used,
+                    image.pixels + level.offset + entry.row * level.rowSize,
+                    rows * level.rowSize);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mStaging.name());
+        glBindTexture(GL_TEXTURE_2D, entry.texture);
+        uploadRows(image, entry.level, entry.row, rows,
+                   reinterpret_cast<GLvoid*>(mStaging.offset() + used));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        used      += rows * level.rowSize;
+        entry.row += rows;
+
+        if(static_cast<GLsizei>(entry.row) == level.rows)
+        {
+            entry.level++;
+            entry.row = 0;
+        }
+
+        if(entry.level == image.levels.size())
+        {
+            if(generatesMipmaps(image))
+            {
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+
+            entry.image.reset();
+            mUpload = nullptr;
+
+            complete(entry, Status::Resident);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // The region is reused once the copies issued from it are done
+    if(staging)
+    {
+        mStaging.end();
+    }
+
+    return pending - mPending;
+}
+
+GLvoid simgll::TextureLoader::finish()
+{
+    for(;;)
+    {
+        update();
+
+        if(mPending == 0)
+        {
+            return;
+        }
+
+        // Nothing left to upload, wait for the workers
+        if(!mUpload)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mReady.wait(lock, [this] { return !mDecoded.empty(); });
+        }
+    }
+}
+
+simgll::TextureLoader::Status
+simgll::TextureLoader::status(Handle handle) const
+{
+    return mEntries[handle]->status;
+}
+
+GLuint simgll::TextureLoader::texture(Handle handle) const
+{
+    const Entry& entry = *mEntries[handle];
+
+    return entry.status == Status::Resident ? entry.texture : 0;
+}
+
+const std::string& simgll::TextureLoader::error(Handle handle) const
+{
+    return mEntries[handle]->error;
+}
+
+GLuint simgll::TextureLoader::pending() const
+{
+    return mPending;
+}
+
+GLvoid simgll::TextureLoader::worker()
+{
+    for(;;)
+    {
+        Handle handle;
+        Entry* entry;
+
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait(lock, [this] { return mStop || !mRequests.empty(); });
+
+            if(mStop)
+            {
+                return;
+            }
+
+            handle = mRequests.front();
+            mRequests.pop_front();
+            entry  = mEntries[handle].get();
+        }
+
+        std::unique_ptr<Image> image(new Image);
+        std::string error;
+        GLboolean read;
+
+        if(entry->pack)
+        {
+            // Only the headers are parsed here, start reading the levels
+            // before update() copies them
+            GLsizeiptr size;
+            const GLubyte* data = entry->pack->find(entry->filename, size);
+
+            if(data)
+            {
+                entry->pack->prefetch(entry->filename);
+                read = readImage(data, size, entry->filename, *image, error);
+            }
+            else
+            {
+                error = "Can't find " + entry->filename + " in the asset pack";
+                read  = GL_FALSE;
+            }
+        }
+        else
+        {
+            read = readImage(entry->filename, *image, error);
+        }
+
+        if(!read)
+        {
+            image.reset();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            entry->image = std::move(image);
+            entry->error = error;
+            mDecoded.push_back(handle);
+        }
+
+        mReady.notify_one();
+    }
+}
+
+GLboolean simgll::TextureLoader::nextUpload()
+{
+    while(!mUpload)
+    {
+        Handle handle;
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            if(mDecoded.empty())
+            {
+                return GL_FALSE;
+            }
+
+            handle = mDecoded.front();
+            mDecoded.pop_front();
+        }
+
+        Entry& entry = *mEntries[handle];
+
+        if(!entry.image)
+        {
+            complete(entry, Status::Failed);
+
+            continue;
+        }
+
+        // Level 0 has the longest rows
+        if(entry.image->levels[0].rowSize > mStaging.regionSize())
+        {
+            entry.error = "Rows of " + entry.filename +
+                          " don't fit in an upload slice";
+        }
+        else
+        {
+            supported(*entry.image, entry.filename, entry.error);
+        }
+
+        if(!entry.error.empty())
+        {
+            entry.image.reset();
+
+            complete(entry, Status::Failed);
+
+            continue;
+        }
+
+        // Every level is allocated up front and filled slice by slice
+        entry.texture = createStorage(*entry.image);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        mUpload = &entry;
+    }
+
+    return GL_TRUE;
+}
+
+GLvoid simgll::TextureLoader::complete(Entry& entry, Status status)
+{
+    entry.status = status;
+
+    mPending--;
+}
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include "threadpool.h"
+
+namespace
+{
+    // Set while a thread runs a chunk, nested loops run inline
+    thread_local bool tInsideLoop = false;
+}
+
+simgll::ThreadPool::ThreadPool(GLuint threads)
+{
+    if(threads == 0)
+    {
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    for(GLuint i = 0; i < threads; i++)
+    {
+        mQueues.emplace_back(new Queue);
+    }
+
+    // The caller is one of the threads
+    for(GLuint i = 1; i < threads; i++)
+    {
+        mThreads.emplace_back(&ThreadPool::worker, this, i);
+    }
+}
+
+simgll::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = GL_TRUE;
+    }
+
+    mWake.notify_all();
+
+    for(std::thread& thread : mThreads)
+    {
+        thread.join();
+    }
+}
+
+GLuint simgll::ThreadPool::size() const
+{
+    return static_cast<GLuint>(mQueues.size());
+}
+
+GLvoid simgll::ThreadPool::parallelFor(std::size_t begin, std::size_t end,
+                                       std::size_t grain, const Body& body)
+{
+    if(begin >= end)
+    {
+        return;
+    }
+
+    grain = std::max<std::size_t>(grain, 1);
+
+    // Inline loops keep the same chunks, bodies can rely on them whatever
+    // the number of threads
+    if(mThreads.empty() || tInsideLoop || end - begin <= grain)
+    {
+        for(std::size_t first = begin; first < end; first += std::min(grain, end - first))
+        {
+            body(first, std::min(first + grain, end));
+        }
+
+        return;
+    }
+
+    std::lock_guard<std::mutex> loopLock(mLoopMutex);
+
+    // Every thread starts with a contiguous block of chunks, so without
+    // stealing each one walks its own part of the range in order
+    std::size_t chunks  = (end - begin + grain - 1) / grain;
+    std::size_t threads = mQueues.size();
+
+    for(std::size_t t = 0; t < threads; t++)
+    {
+        std::lock_guard<std::mutex> lock(mQueues[t]->mutex);
+
+        for(std::size_t c = t * chunks / threads; c < (t + 1) * chunks / threads; c++)
+        {
+            mQueues[t]->chunks.push_back(c);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        mBody  = &body;
+        mBegin = begin;
+        mEnd   = end;
+        mGrain = grain;
+        mOpen  = GL_TRUE;
+        mGeneration++;
+    }
+
+    mWake.notify_all();
+
+    runChunks(0);
+
+    // Every chunk has been taken, wait for the workers still running one
+    std::unique_lock<std::mutex> lock(mMutex);
+    mOpen = GL_FALSE;
+    mDone.wait(lock, [this] { return mActive == 0; });
+    mBody = nullptr;
+}
+
+simgll::ThreadPool& simgll::ThreadPool::global()
+{
+    static ThreadPool pool;
+
+    return pool;
+}
+
+GLvoid simgll::ThreadPool::worker(GLuint index)
+{
+    GLuint generation = 0;
+
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait(lock, [&] { return mStop || (mOpen && mGeneration != generation); });
+
+            if(mStop)
+            {
+                return;
+            }
+
+            generation = mGeneration;
+            mActive++;
+        }
+
+        runChunks(index);
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mActive--;
+        }
+
+        mDone.notify_one();
+    }
+}
+
+GLvoid simgll::ThreadPool::runChunks(GLuint index)
+{
+    tInsideLoop = true;
+
+    std::size_t chunk;
+
+    while(takeChunk(index, chunk))
+    {
+        std::size_t first = mBegin + chunk * mGrain;
+
+        (*mBody)(first, std::min(first + mGrain, mEnd));
+    }
+
+    tInsideLoop = false;
+}
+
+GLboolean simgll::ThreadPool::takeChunk(GLuint index, std::size_t& chunk)
+{
+    {
+        Queue& own = *mQueues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+
+        if(!own.chunks.empty())
+        {
+            chunk = own.chunks.front();
+            own.chunks.pop_front();
+
+            return GL_TRUE;
+        }
+    }
+
+    // Chunks are never added during a loop, once every queue has been found
+    // empty the thread is done
+    for(std::size_t i = 1; i < mQueues.size(); i++)
+    {
+        Queue& victim = *mQueues[(index + i) % mQueues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if(!victim.chunks.empty())
+        {
+            chunk = victim.chunks.back();
+            victim.chunks.pop_back();
+
+            return GL_TRUE;
+        }
+    }
+
+    return GL_FALSE;
+}
@@ -0,0 +1,81 @@
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <FreeImage.h>
+
+#include "assetpack.h"
+#include "texture.h"
+
+// Builds an asset pack out of loose files:
+//
+//     simgll-pack output.pack [name=]path...
+//
+// Assets are named after the path unless a name is given. KTX and DDS files
+// are stored as they are, other images known to FreeImage are decoded once
+// here and stored as KTX, the rest is stored as it is.
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " output.pack [name=]path...\n";
+
+        return 1;
+    }
+
+    std::vector<simgll::AssetPack::Asset> assets;
+    std::string error;
+
+    for(int i = 2; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        std::size_t equal    = argument.find('=');
+
+        simgll::AssetPack::Asset asset;
+        asset.name = argument.substr(0, equal);
+
+        std::string path = equal != std::string::npos ?
+                           argument.substr(equal + 1) : argument;
+
+        std::ifstream file(path, std::ios::binary);
+
+        if(!file)
+        {
+            std::cerr << "Can't open " << path << "\n";
+
+            return 1;
+        }
+
+        asset.data.assign(std::istreambuf_iterator<char>(file),
+                          std::istreambuf_iterator<char>());
+
+        simgll::Image image;
+
+        if(!simgll::readImage(asset.data.data(), asset.data.size(), path, image,
+                              error) &&
+           FreeImage_GetFileType(path.c_str(), 0) != FIF_UNKNOWN)
+        {
+            if(!simgll::readImage(path, image, error))
+            {
+                std::cerr << error << "\n";
+
+                return 1;
+            }
+
+            asset.data = simgll::writeKtx(image);
+        }
+
+        assets.push_back(asset);
+    }
+
+    if(!simgll::AssetPack::write(argv[1], assets, error))
+    {
+        std::cerr << error << "\n";
+
+        return 1;
+    }
+
+    return 0;
+}